@@ -0,0 +1,171 @@
+#!/bin/sh
+# SPDX-License-Identifier: MPL-2.0
+# Copyright 2026 Eve Kivivuori
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at https://mozilla.org/MPL/2.0/.
+
+# End-to-end benchmarks: generates synthetic inputs, builds dictionaries
+# and suffix arrays for them, and times builddict, endflip, divsuffix,
+# rlzparse and rlzunparse on them.
+# Run through "make bench", or from this directory after "make".
+#
+# Output is one JSON object per line on stdout, one line per tool run:
+#   {"tool": "rlzparse", "corpus": "versioned", "size": 8388608, "width": 8,
+#    "format": "vbyte", "wall_s": ..., "user_s": ..., "sys_s": ...,
+#    "max_rss_kib": ..., "in_bytes": ..., "out_bytes": ..., "mb_per_s": ...,
+#    "tokens": ..., "tokens_per_s": ..., "ratio": ..., "ok": true}
+# mb_per_s is megabytes (10^6) of uncompressed data per wall-clock second,
+# ratio is out_bytes / in_bytes. tokens and tokens_per_s are null where
+# they don't apply or aren't counted (-f delta), and ok is false when the
+# tool failed or, for rlzunparse, didn't give back the original input.
+# Progress messages go to stderr.
+#
+# Environment variables:
+#   BENCH_SIZES    input sizes, default "1M 8M"; K, M and G suffixes work
+#   BENCH_KINDS    default "random repetitive versioned ints"
+#   BENCH_FORMATS  RLZ formats to parse into, default "32x2 vbyte"
+#   BENCH_SEED     default 1; same seed, same inputs
+#   BENCH_DICT_PCT dictionary size as a percentage of input, default 5
+#   BENCH_BUILD    where the binaries are, default ../build
+
+BUILD=${BENCH_BUILD:-../build}
+SIZES=${BENCH_SIZES:-"1M 8M"}
+KINDS=${BENCH_KINDS:-"random repetitive versioned ints"}
+FORMATS=${BENCH_FORMATS:-"32x2 vbyte"}
+SEED=${BENCH_SEED:-1}
+DICT_PCT=${BENCH_DICT_PCT:-5}
+SAMPLE_LENGTH=1000
+
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/rlzbench.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+trap 'exit 130' INT TERM
+
+filesize () {
+	if [ -f "$1" ]; then wc -c < "$1" | tr -d ' '; else echo 0; fi
+}
+
+# Prints true if the last measured command exited successfully.
+status_ok () {
+	if [ "$STATUS" -eq 0 ]; then echo true; else echo false; fi
+}
+
+# Params: statfile name, then the command to run.
+# Sets WALL, UTIME, STIME, RSS and STATUS from runstat's output.
+measure () {
+	local statfile
+	statfile=$1; shift
+	"$BUILD/bench/runstat" "$statfile" "$@" > /dev/null
+	read WALL UTIME STIME RSS STATUS < "$statfile"
+}
+
+# Params: tool, corpus, size, width, format, in_bytes, out_bytes,
+# uncompressed bytes (for MB/s), tokens (empty if unknown), ok (true/false).
+# Uses WALL, UTIME, STIME and RSS from the last measure call.
+report () {
+	awk -v tool="$1" -v corpus="$2" -v size="$3" -v width="$4" \
+		-v format="$5" -v in_bytes="$6" -v out_bytes="$7" \
+		-v plain_bytes="$8" -v tokens="$9" -v ok="${10}" \
+		-v wall="$WALL" -v user="$UTIME" -v sys="$STIME" -v rss="$RSS" \
+		'BEGIN {
+			w = wall > 0 ? wall : 1e-9;
+			if (tokens == "") {
+				tok = "null"; tok_s = "null";
+			} else {
+				tok = sprintf("%d", tokens);
+				tok_s = sprintf("%.1f", tokens / w);
+			}
+			printf("{\"tool\": \"%s\", \"corpus\": \"%s\", \"size\": %d, " \
+				"\"width\": %d, \"format\": \"%s\", \"wall_s\": %.6f, " \
+				"\"user_s\": %.6f, \"sys_s\": %.6f, \"max_rss_kib\": %d, " \
+				"\"in_bytes\": %d, \"out_bytes\": %d, \"mb_per_s\": %.3f, " \
+				"\"tokens\": %s, \"tokens_per_s\": %s, \"ratio\": %.6f, " \
+				"\"ok\": %s}\n",
+				tool, corpus, size, width, format, wall, user, sys, rss,
+				in_bytes, out_bytes, plain_bytes / w / 1e6, tok, tok_s,
+				in_bytes > 0 ? out_bytes / in_bytes : 0, ok);
+		}'
+}
+
+# Params: kind, size. Runs the whole pipeline on one input.
+bench_corpus () {
+	local kind size width bytes_per_sym input dict sa n_samples
+	kind=$1; size=$2
+	width=8; bytes_per_sym=1
+	if [ "$kind" = ints ]; then width=32; bytes_per_sym=4; fi
+	input=$WORK/$kind-$size
+	dict=$input.dict
+	sa=$input.sa
+
+	echo "bench: $kind $size" >&2
+	"$BUILD/bench/gencorpus" "$kind" "$size" "$SEED" "$input" || return 1
+	size=$(filesize "$input")
+	n_samples=$((size * DICT_PCT / 100 / SAMPLE_LENGTH / bytes_per_sym))
+	[ "$n_samples" -lt 1 ] && n_samples=1
+
+	measure "$WORK/stat" "$BUILD/builddict" -q -w $width -n $n_samples \
+		-l $SAMPLE_LENGTH -i "$input" -o "$dict"
+	report builddict "$kind" "$size" $width "" "$size" "$(filesize "$dict")" \
+		"$size" "" "$(status_ok)"
+	[ "$STATUS" -eq 0 ] || return 1
+
+	if [ $width -eq 8 ]; then
+		"$BUILD/bench/mksa" "$dict" "$sa" || return 1
+	else
+		# The usual wide-symbol suffix array pipeline from the README.
+		measure "$WORK/stat" "$BUILD/rlztools.endflip" $bytes_per_sym \
+			"$dict" "$dict.flipped"
+		report endflip "$kind" "$size" $width "" "$(filesize "$dict")" \
+			"$(filesize "$dict.flipped")" "$(filesize "$dict")" "" "$(status_ok)"
+		[ "$STATUS" -eq 0 ] || return 1
+		"$BUILD/bench/mksa" "$dict.flipped" "$sa.8" || return 1
+		rm -f "$sa"
+		measure "$WORK/stat" "$BUILD/rlztools.divsuffix" $bytes_per_sym \
+			"$sa.8" "$sa"
+		report divsuffix "$kind" "$size" $width "" "$(filesize "$sa.8")" \
+			"$(filesize "$sa")" "$(filesize "$sa.8")" "" "$(status_ok)"
+		[ "$STATUS" -eq 0 ] || return 1
+		rm -f "$dict.flipped" "$sa.8"
+	fi
+
+	for fmt in $FORMATS; do
+		local rlz out tokens rlz_bytes ok
+		rlz=$input.$fmt.rlz
+		out=$input.$fmt.out
+		measure "$WORK/stat" "$BUILD/rlzparse" -q -w $width -i "$input" \
+			-d "$dict" -s "$sa" -f $fmt -o "$rlz"
+		ok=$(status_ok)
+		rlz_bytes=$(filesize "$rlz")
+		tokens=
+		if [ $ok = true ]; then
+			case $fmt in
+				32x2) tokens=$((rlz_bytes / 8)) ;;
+				64x2) tokens=$((rlz_bytes / 16)) ;;
+				vbyte) tokens=$("$BUILD/rlztools.count-vbyte-tokens" "$rlz") ;;
+				ascii) tokens=$(wc -l < "$rlz" | tr -d ' ') ;;
+			esac
+		fi
+		report rlzparse "$kind" "$size" $width $fmt "$size" "$rlz_bytes" \
+			"$size" "$tokens" $ok
+		if [ $ok = false ]; then
+			echo "bench: rlzparse -f $fmt failed, skipping rlzunparse" >&2
+			rm -f "$rlz"
+			continue
+		fi
+
+		measure "$WORK/stat" "$BUILD/rlzunparse" -q -w $width -f $fmt \
+			-d "$dict" -i "$rlz" -o "$out"
+		ok=$(status_ok)
+		if [ $ok = true ] && ! cmp -s "$out" "$input"; then ok=false; fi
+		report rlzunparse "$kind" "$size" $width $fmt "$rlz_bytes" \
+			"$(filesize "$out")" "$size" "$tokens" $ok
+		rm -f "$rlz" "$out"
+	done
+	rm -f "$input" "$dict" "$sa"
+}
+
+for size in $SIZES; do
+	for kind in $KINDS; do
+		bench_corpus "$kind" "$size"
+	done
+done
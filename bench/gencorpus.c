@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* gencorpus: generate synthetic benchmark inputs for the rlztools.
+ *
+ * Usage:
+ * gencorpus KIND SIZE SEED outfile
+ * KIND is one of:
+ *   random      uniformly random bytes; nearly incompressible, and so
+ *               mostly literals and very short phrases.
+ *   repetitive  a 4 KiB random block repeated over and over, with a point
+ *               mutation every few kilobytes. Very long phrases.
+ *   versioned   a made-up document of random "words", followed by edited
+ *               copies of itself, like the concatenated revision history
+ *               of a wiki page. This is the typical RLZ use case.
+ *   ints        like versioned, but made of 32-bit little-endian integers
+ *               drawn from a few thousand distinct values, for -w 32.
+ * SIZE is the output size in bytes; a K, M or G suffix multiplies it by
+ * 1024, 1024^2 or 1024^3. The same SEED always gives the same output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#define BLOCK_SIZE 4096
+#define MUTATION_INTERVAL 3000
+#define N_DISTINCT_INTS 5000
+#define EDITS_PER_VERSION 8
+
+static uint64_t rng_state;
+
+/* xorshift64*: fast, and the same on every platform, unlike rand(). */
+static uint64_t next_random(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t random_below(uint64_t n) {
+	return n == 0 ? 0 : next_random() % n;
+}
+
+static void gen_random(uint8_t* buf, size_t size) {
+	for (size_t i = 0; i < size; i++)
+		buf[i] = (uint8_t) next_random();
+}
+
+static void gen_repetitive(uint8_t* buf, size_t size) {
+	uint8_t block[BLOCK_SIZE];
+	gen_random(block, BLOCK_SIZE);
+	for (size_t i = 0; i < size; i++)
+		buf[i] = block[i % BLOCK_SIZE];
+	for (size_t i = MUTATION_INTERVAL; i < size; i += MUTATION_INTERVAL)
+		buf[i - random_below(MUTATION_INTERVAL / 2)] = (uint8_t) next_random();
+}
+
+/* Fills buf with versions of a document made of `unit`-byte symbols
+ * generated by next_symbol(). The first version is 1/16th of the output
+ * (but at least 4 KiB); every next version is a copy of the previous one
+ * with a handful of random deletions, insertions and replacements. */
+static void gen_versions(uint8_t* buf, size_t size, size_t unit,
+                         void (*next_symbol)(uint8_t*)) {
+	size_t version_len = size / 16 / unit * unit;
+	if (version_len < BLOCK_SIZE) version_len = BLOCK_SIZE;
+	if (version_len > size) version_len = size / unit * unit;
+	for (size_t i = 0; i + unit <= version_len; i += unit)
+		next_symbol(buf + i);
+	size_t prev = 0, out = version_len;
+	while (out < size) {
+		size_t len = version_len;
+		if (out + len > size) len = size - out;
+		memcpy(buf + out, buf + prev, len);
+		size_t n_units = len / unit;
+		for (int e = 0; e < EDITS_PER_VERSION && n_units > 64; e++) {
+			size_t at = random_below(n_units - 32) * unit;
+			size_t span = (1 + random_below(16)) * unit;
+			switch (random_below(3)) {
+			case 0: /* delete span symbols, pull the rest back */
+				memmove(buf + out + at, buf + out + at + span, len - at - span);
+				for (size_t i = len - span; i + unit <= len; i += unit)
+					next_symbol(buf + out + i);
+				break;
+			case 1: /* insert span new symbols, push the rest forward */
+				memmove(buf + out + at + span, buf + out + at, len - at - span);
+				/* fallthrough */
+			default: /* replace */
+				for (size_t i = 0; i < span; i += unit)
+					next_symbol(buf + out + at + i);
+				break;
+			}
+		}
+		prev = out;
+		out += len;
+	}
+}
+
+static const char* const words[] = {
+	"the ", "of ", "and ", "a ", "to ", "in ", "is ", "you ", "that ", "it ",
+	"he ", "was ", "for ", "on ", "are ", "as ", "with ", "his ", "they ",
+	"compression ", "dictionary ", "suffix ", "array ", "phrase ", "token ",
+	"relative ", "Lempel-Ziv ", "revision ", "article ", "version ", ". ",
+	", ", "\n", "\n\n", "== History ==\n", "[[link]] ", "{{cite}} ", "1996 "
+};
+static const char* pending_word = "";
+
+static void next_text_byte(uint8_t* out) {
+	if (*pending_word == '\0')
+		pending_word = words[random_below(sizeof(words) / sizeof(words[0]))];
+	*out = (uint8_t) *pending_word++;
+}
+
+static uint32_t int_pool[N_DISTINCT_INTS];
+
+static void next_int(uint8_t* out) {
+	/* Skewed towards the start of the pool, like real IDs tend to be. */
+	uint32_t x = int_pool[random_below(1 + random_below(N_DISTINCT_INTS))];
+	for (int i = 0; i < 4; i++)
+		out[i] = (uint8_t) (x >> (8 * i));
+}
+
+static size_t parse_size(const char* s) {
+	char* end;
+	size_t n = strtoull(s, &end, 10);
+	switch (*end) {
+	case 'G': case 'g': n *= 1024; /* fallthrough */
+	case 'M': case 'm': n *= 1024; /* fallthrough */
+	case 'K': case 'k': n *= 1024; break;
+	default: break;
+	}
+	return n;
+}
+
+int main(int argc, const char** argv) {
+	if (argc != 5) {
+		fputs("gencorpus: generate synthetic benchmark input.\n"
+		      "Usage: gencorpus random|repetitive|versioned|ints SIZE SEED outfile\n"
+		      "SIZE is in bytes, and may have a K, M or G suffix.\n", stderr);
+		return 1;
+	}
+	const char* kind = argv[1];
+	size_t size = parse_size(argv[2]);
+	rng_state = strtoull(argv[3], NULL, 10) * 2654435761ULL + 1;
+
+	uint8_t* buf = malloc(size > 0 ? size : 1);
+	if (buf == NULL) {
+		fputs("gencorpus: out of memory\n", stderr);
+		return 2;
+	}
+	if (strcmp(kind, "random") == 0) {
+		gen_random(buf, size);
+	} else if (strcmp(kind, "repetitive") == 0) {
+		gen_repetitive(buf, size);
+	} else if (strcmp(kind, "versioned") == 0) {
+		gen_versions(buf, size, 1, next_text_byte);
+	} else if (strcmp(kind, "ints") == 0) {
+		for (int i = 0; i < N_DISTINCT_INTS; i++)
+			int_pool[i] = (uint32_t) next_random();
+		size = size / 4 * 4;
+		gen_versions(buf, size, 4, next_int);
+	} else {
+		fprintf(stderr, "gencorpus: unknown kind '%s'\n", kind);
+		return 1;
+	}
+
+	errno = 0;
+	FILE* outfile = fopen(argv[4], "wb");
+	if (outfile == NULL) {
+		fprintf(stderr, "error opening output file '%s': %s\n",
+		        argv[4], strerror(errno));
+		return 3;
+	}
+	if (fwrite(buf, 1, size, outfile) != size) {
+		fprintf(stderr, "error writing '%s'\n", argv[4]);
+		return 3;
+	}
+	fclose(outfile);
+	free(buf);
+	return 0;
+}
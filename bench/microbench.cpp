@@ -0,0 +1,391 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* microbench: time the inner loops of rlzparse and rlzunparse one at a time,
+ * where bench.sh only times whole runs of the programs.
+ *
+ * Usage: microbench [-s SEED] [-n INPUT_SIZE] [-d DICT_SIZE] [-r REPEATS]
+ *
+ * A dictionary and an input file are generated from SEED (default 1), with
+ * the input made of edited copies of pieces of the dictionary, so that the
+ * token lengths and suffix array ranges look like those of real data.
+ * Then each of these is run REPEATS times (default 5):
+ *   parse         Parser::next_token() over the whole input
+ *   search_left   Parser::search_left() calls, replayed from the parse
+ *   search_right  same for search_right()
+ *   encode        output_token() for each output format
+ *   decode        RLZInputReader::next_token() for each format
+ *   write_next    OutputWriter::write_next() for each token
+ * and the fastest run of each is printed as one JSON line on stdout:
+ *   {"bench": "decode", "variant": "vbyte", "ops": 123, "ns_per_op": ...,
+ *    "mb_per_s": ..., "cycles_per_op": ..., "instructions_per_op": ...,
+ *    "llc_misses_per_op": ..., "dtlb_misses_per_op": ...,
+ *    "branch_misses_per_op": ...}
+ * mb_per_s counts the uncompressed symbols handled, and is 0 where that
+ * doesn't mean anything. The per-op counter values are null if the kernel
+ * doesn't let us read hardware counters (see PerfCounters in rlzcommon.h).
+ * Symbols are 8-bit, the suffix array 32-bit.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "../src/rlzcommon.h"
+#include "../src/rlzparse.h"
+#include "../src/rlzunparse.h"
+#include "suffixsort.h"
+
+#define DEFAULT_SEED 1
+#define DEFAULT_INPUT_SIZE (4 * 1024 * 1024)
+#define DEFAULT_DICT_SIZE (1024 * 1024)
+#define DEFAULT_REPEATS 5
+// Most search_left/search_right calls to record for replaying.
+#define MAX_SEARCH_CALLS 2000000
+
+using std::cerr;
+using std::string;
+using std::vector;
+using steady_clock = std::chrono::steady_clock;
+
+// Results are added here so that the compiler can't skip the work.
+volatile uint64_t sink;
+
+static uint64_t rng_state;
+
+// xorshift64*, the same generator as in gencorpus.c.
+static uint64_t next_random()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t random_below(uint64_t n)
+{
+    return n == 0 ? 0 : next_random() % n;
+}
+
+static const char* const words[] = {
+    "the ", "of ", "and ", "a ", "to ", "in ", "is ", "you ", "that ", "it ",
+    "he ", "was ", "for ", "on ", "are ", "as ", "with ", "his ", "they ",
+    "compression ", "dictionary ", "suffix ", "array ", "phrase ", "token ",
+    "relative ", "Lempel-Ziv ", "revision ", "article ", "version ", ". ",
+    ", ", "\n", "\n\n", "== History ==\n", "[[link]] ", "{{cite}} ", "1996 "
+};
+
+// Random text made of the words above.
+static vector<uint8_t> make_dictionary(size_t size)
+{
+    vector<uint8_t> dict;
+    dict.reserve(size);
+    while (dict.size() < size) {
+        const char* w = words[random_below(sizeof(words) / sizeof(words[0]))];
+        for (; *w != '\0' && dict.size() < size; w++)
+            dict.push_back((uint8_t) *w);
+    }
+    return dict;
+}
+
+/* Pieces of the dictionary, from a few symbols to a few thousand long,
+ * with a changed symbol here and there; one change in a hundred is a byte
+ * that isn't in the dictionary, and becomes a literal. */
+static vector<uint8_t> make_input(const vector<uint8_t>& dict, size_t size)
+{
+    vector<uint8_t> input;
+    input.reserve(size);
+    while (input.size() < size) {
+        size_t len = 1 + random_below(1 + random_below(1000));
+        size_t pos = random_below(dict.size() - len);
+        for (size_t i = 0; i < len && input.size() < size; i++)
+            input.push_back(dict[pos + i]);
+        if (input.size() < size) {
+            if (random_below(100) == 0)
+                input.push_back(0x80 | (uint8_t) next_random());
+            else
+                input.push_back(dict[random_below(dict.size())]);
+        }
+    }
+    return input;
+}
+
+template <typename T>
+static void write_file(const string& name, const vector<T>& data)
+{
+    std::ofstream out(name, std::ofstream::binary | std::ofstream::trunc);
+    out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(T));
+    if (!out) {
+        cerr << "microbench: error writing " << name << "\n";
+        exit(3);
+    }
+}
+
+/* Times repeated runs of one benchmark, and keeps the fastest one. Use as
+ * "for each repeat: set up; timer.start(); work; timer.stop();", then
+ * report(). */
+class Timer {
+private:
+    PerfCounters* perf;
+    steady_clock::time_point start_time;
+    double best_ns;
+    long long best_counts[PERF_N_EVENTS];
+
+public:
+    Timer(PerfCounters* perf) : perf(perf), best_ns(-1) {}
+
+    void start()
+    {
+        perf->start();
+        start_time = steady_clock::now();
+    }
+
+    void stop()
+    {
+        double ns = std::chrono::duration<double, std::nano>(
+                        steady_clock::now() - start_time).count();
+        perf->stop();
+        if (best_ns < 0 || ns < best_ns) {
+            best_ns = ns;
+            for (int e = 0; e < PERF_N_EVENTS; e++)
+                best_counts[e] = perf->get(e);
+        }
+    }
+
+    // ops is the number of calls timed, symbols the uncompressed symbols
+    // (= bytes) that they handled together, or 0.
+    void report(string bench, string variant, uint64_t ops, uint64_t symbols)
+    {
+        if (ops == 0) ops = 1;
+        std::cout << std::fixed << "{\"bench\": \"" << bench
+                  << "\", \"variant\": \"" << variant
+                  << "\", \"ops\": " << ops
+                  << ", \"ns_per_op\": " << std::setprecision(3) << best_ns / ops
+                  << ", \"mb_per_s\": " << (symbols * 1e3 / best_ns);
+        for (int e = 0; e < PERF_N_EVENTS; e++) {
+            std::cout << ", \"" << PerfCounters::name(e) << "_per_op\": ";
+            if (best_counts[e] < 0)
+                std::cout << "null";
+            else
+                std::cout << (double) best_counts[e] / ops;
+        }
+        std::cout << "}" << std::endl;
+    }
+};
+
+// One recorded call: search_x(c, offset, left, right).
+struct SearchCall {
+    uint8_t c;
+    int offset;
+    long long left;
+    long long right;
+};
+
+/* Re-runs the suffix array range narrowing that next_token() does for each
+ * phrase in tokens, and records every search_left and search_right call it
+ * makes. */
+static void record_searches(Parser<uint8_t, uint32_t>* parser,
+                            const vector<RLZToken>& tokens,
+                            vector<SearchCall>* lefts, vector<SearchCall>* rights)
+{
+    for (const RLZToken& tok : tokens) {
+        if (tok.length == 0) continue;
+        long long left = 0, right = parser->sa.size() - 1;
+        for (int offset = 0; offset < tok.length; offset++) {
+            if (lefts->size() >= MAX_SEARCH_CALLS) return;
+            uint8_t c = parser->dict[tok.start_pos + offset];
+            lefts->push_back(SearchCall{c, offset, left, right});
+            left = parser->search_left(c, offset, left, right);
+            rights->push_back(SearchCall{c, offset, left, right});
+            right = parser->search_right(c, offset, left, right);
+            if (left == right) break;
+        }
+    }
+}
+
+void print_help()
+{
+    cerr << "microbench: time the inner loops of rlzparse and rlzunparse.\n"
+            "Usage: microbench [-s SEED] [-n INPUT_SIZE] [-d DICT_SIZE] [-r REPEATS]\n"
+            "Results are printed as JSON, one line per benchmark.\n";
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t seed = DEFAULT_SEED;
+    size_t input_size = DEFAULT_INPUT_SIZE;
+    size_t dict_size = DEFAULT_DICT_SIZE;
+    int repeats = DEFAULT_REPEATS;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--help") {
+            print_help();
+            exit(0);
+        }
+        if (i + 1 >= argc) {
+            print_help();
+            exit(EXIT_USER_ERROR);
+        }
+        if (arg == "-s") seed = strtoull(argv[++i], NULL, 10);
+        else if (arg == "-n") input_size = strtoull(argv[++i], NULL, 10);
+        else if (arg == "-d") dict_size = strtoull(argv[++i], NULL, 10);
+        else if (arg == "-r") repeats = atoi(argv[++i]);
+        else {
+            print_help();
+            exit(EXIT_USER_ERROR);
+        }
+    }
+    if (input_size < 1 || dict_size < 8192 || repeats < 1) {
+        cerr << "Bad arguments: need INPUT_SIZE >= 1, DICT_SIZE >= 8192, REPEATS >= 1\n";
+        exit(EXIT_USER_ERROR);
+    }
+
+    /* Setup *****/
+    char dir_template[] = "/tmp/rlzmicrobench.XXXXXX";
+    const char* tmpdir = mkdtemp(dir_template);
+    if (tmpdir == NULL) {
+        perror("microbench: mkdtemp");
+        exit(3);
+    }
+    string dir = tmpdir;
+    string dict_name = dir + "/dict", sa_name = dir + "/sa";
+    string input_name = dir + "/input", output_name = dir + "/output";
+
+    rng_state = seed * 2654435761ULL + 1;
+    vector<uint8_t> dict = make_dictionary(dict_size);
+    vector<uint8_t> input = make_input(dict, input_size);
+    write_file(dict_name, dict);
+    write_file(sa_name, suffix_sort(dict));
+    write_file(input_name, input);
+
+    PerfCounters perf;
+    cerr << "microbench: seed " << seed << ", " << input_size << "-byte input, "
+         << dict_size << "-byte dictionary, best of " << repeats << " runs; "
+         << (perf.available() ? "with" : "no") << " hardware counters\n";
+
+    /* Parsing *****/
+    vector<RLZToken> tokens;
+    {
+        Timer timer(&perf);
+        for (int r = 0; r < repeats; r++) {
+            Parser<uint8_t, uint32_t> parser(input_name, dict_name, sa_name, false);
+            tokens.clear();
+            tokens.reserve(input_size);
+            timer.start();
+            for (;;) {
+                RLZToken tok = parser.next_token();
+                if (is_end_sentinel(&tok)) break;
+                tokens.push_back(tok);
+            }
+            timer.stop();
+        }
+        timer.report("parse", "next_token", tokens.size(), input.size());
+    }
+
+    {
+        Parser<uint8_t, uint32_t> parser(input_name, dict_name, sa_name, false);
+        vector<SearchCall> lefts, rights;
+        record_searches(&parser, tokens, &lefts, &rights);
+
+        Timer left_timer(&perf);
+        for (int r = 0; r < repeats; r++) {
+            uint64_t sum = 0;
+            left_timer.start();
+            for (const SearchCall& s : lefts)
+                sum += parser.search_left(s.c, s.offset, s.left, s.right);
+            left_timer.stop();
+            sink = sink + sum;
+        }
+        left_timer.report("search_left", "8/32", lefts.size(), 0);
+
+        Timer right_timer(&perf);
+        for (int r = 0; r < repeats; r++) {
+            uint64_t sum = 0;
+            right_timer.start();
+            for (const SearchCall& s : rights)
+                sum += parser.search_right(s.c, s.offset, s.left, s.right);
+            right_timer.stop();
+            sink = sink + sum;
+        }
+        right_timer.report("search_right", "8/32", rights.size(), 0);
+    }
+
+    /* Token formats *****/
+    struct { const char* name; int mode; } formats[] = {
+        { "32x2", FMT_32X2 }, { "64x2", FMT_64X2 },
+        { "ascii", FMT_ASCII }, { "vbyte", FMT_VBYTE },
+        { "delta", FMT_DELTA }
+    };
+    for (auto& fmt : formats) {
+        string rlz_name = dir + "/rlz." + fmt.name;
+        Timer timer(&perf);
+        for (int r = 0; r < repeats; r++) {
+            std::ofstream out(rlz_name, std::ofstream::binary | std::ofstream::trunc);
+            uint64_t bytes_output = 0, delta_prev_end = 0;
+            timer.start();
+            for (const RLZToken& tok : tokens)
+                output_token(tok, &out, fmt.mode, &bytes_output, &delta_prev_end);
+            output_token(end_sentinel, &out, fmt.mode, &bytes_output);
+            timer.stop();
+        }
+        timer.report("encode", fmt.name, tokens.size(), input.size());
+    }
+
+    for (auto& fmt : formats) {
+        string rlz_name = dir + "/rlz." + fmt.name;
+        Timer timer(&perf);
+        uint64_t n_read = 0;
+        for (int r = 0; r < repeats; r++) {
+            RLZInputReader reader(rlz_name, fmt.mode);
+            n_read = 0;
+            timer.start();
+            while (reader.keep_going()) {
+                RLZToken tok = reader.next_token();
+                if (is_end_sentinel(&tok)) break;
+                n_read++;
+            }
+            timer.stop();
+        }
+        if (n_read != tokens.size()) {
+            cerr << "microbench: bug: decoded " << n_read << " " << fmt.name
+                 << " tokens, expected " << tokens.size() << "\n";
+            exit(EXIT_BUG);
+        }
+        timer.report("decode", fmt.name, n_read, input.size());
+        unlink(rlz_name.c_str());
+    }
+
+    /* Unparsing *****/
+    {
+        OutputWriter<uint8_t> writer(dict_name, output_name);
+        Timer timer(&perf);
+        for (int r = 0; r < repeats; r++) {
+            uint64_t written = 0;
+            timer.start();
+            for (const RLZToken& tok : tokens)
+                written += writer.write_next(tok);
+            timer.stop();
+            sink = sink + written;
+        }
+        timer.report("write_next", "8", tokens.size(), input.size());
+    }
+
+    unlink(dict_name.c_str());
+    unlink(sa_name.c_str());
+    unlink(input_name.c_str());
+    unlink(output_name.c_str());
+    rmdir(tmpdir);
+    return 0;
+}
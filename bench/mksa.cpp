@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* mksa: a small, slow, dependency-free suffix array builder, so that the
+ * benchmarks can run without libdivsufsort or pSAscan installed.
+ *
+ * Usage: mksa infile outfile
+ *
+ * Input is treated as bytes; output is 32-bit integers in machine byte
+ * order, like rlzparse expects. Wide-symbol suffix arrays are made the same
+ * way as with any other byte-oriented builder (endflip, mksa, divsuffix).
+ */
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "suffixsort.h"
+
+using std::cerr;
+using std::vector;
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        cerr << "mksa: build the suffix array of a file of bytes.\n"
+                "Usage: mksa infile outfile\n";
+        return 1;
+    }
+    std::ifstream infile(argv[1], std::ifstream::binary);
+    if (!infile) {
+        cerr << "mksa: can't open input file " << argv[1] << "\n";
+        return 2;
+    }
+    vector<uint8_t> text((std::istreambuf_iterator<char>(infile)),
+                         std::istreambuf_iterator<char>());
+    size_t n = text.size();
+    if (n >= UINT32_MAX) {
+        cerr << "mksa: input too big for a 32-bit suffix array\n";
+        return 2;
+    }
+
+    vector<uint32_t> sa = suffix_sort(text);
+
+    std::ofstream outfile(argv[2], std::ofstream::binary | std::ofstream::trunc);
+    outfile.write(reinterpret_cast<const char*>(sa.data()), n * sizeof(uint32_t));
+    if (!outfile) {
+        cerr << "mksa: error writing " << argv[2] << "\n";
+        return 3;
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* runstat: run a command and record how long it took and how much memory
+ * it needed, because GNU time(1) isn't installed everywhere and its output
+ * format differs between systems.
+ *
+ * Usage: runstat statfile command [args...]
+ *
+ * The command's stdin, stdout and stderr are passed through untouched.
+ * Once it exits, one line is written into statfile:
+ *   wall_seconds user_seconds sys_seconds max_rss_kib exit_status
+ * and runstat itself exits with the command's exit status.
+ */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static double seconds(struct timeval tv) {
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fputs("runstat: run a command, record its time and peak memory use.\n"
+		      "Usage: runstat statfile command [args...]\n"
+		      "statfile gets: wall_s user_s sys_s max_rss_kib exit_status\n",
+		      stderr);
+		return 127;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("runstat: fork");
+		return 127;
+	}
+	if (pid == 0) {
+		execvp(argv[2], argv + 2);
+		fprintf(stderr, "runstat: can't run '%s': %s\n", argv[2], strerror(errno));
+		_exit(127);
+	}
+
+	int status = 0;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) < 0) {
+		perror("runstat: wait4");
+		return 127;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	int exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+	FILE* statfile = fopen(argv[1], "w");
+	if (statfile == NULL) {
+		fprintf(stderr, "runstat: can't open '%s': %s\n", argv[1], strerror(errno));
+		return 127;
+	}
+	/* ru_maxrss is in kilobytes on Linux (but bytes on macOS). */
+	fprintf(statfile, "%.6f %.6f %.6f %ld %d\n", wall,
+	        seconds(usage.ru_utime), seconds(usage.ru_stime),
+	        usage.ru_maxrss, exit_status);
+	fclose(statfile);
+	return exit_status;
+}
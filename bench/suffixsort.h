@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* The suffix array builder behind mksa, also used by microbench.
+ *
+ * This is plain prefix doubling with std::sort, O(n log^2 n): fine for the
+ * few-megabyte dictionaries the benchmarks use, but not something to point
+ * at a real multi-gigabyte dictionary.
+ */
+#ifndef RLZ_SUFFIXSORT_H_INCLUDED
+#define RLZ_SUFFIXSORT_H_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Returns the suffix array of text, treated as bytes.
+inline std::vector<uint32_t> suffix_sort(const std::vector<uint8_t>& text)
+{
+    size_t n = text.size();
+    std::vector<uint32_t> sa(n), rank(n), tmp(n);
+    for (size_t i = 0; i < n; i++) {
+        sa[i] = i;
+        rank[i] = text[i];
+    }
+    // After the round with step k, suffixes are sorted by their first 2k
+    // symbols; rank[i] is the bucket of suffix i. Suffixes shorter than the
+    // comparison window sort first, as if ended by a smallest-ever symbol.
+    for (size_t k = 1; n > 0; k *= 2) {
+        auto key2 = [&](uint32_t i) -> int64_t {
+            return i + k < n ? (int64_t) rank[i + k] : -1;
+        };
+        auto cmp = [&](uint32_t a, uint32_t b) {
+            if (rank[a] != rank[b]) return rank[a] < rank[b];
+            return key2(a) < key2(b);
+        };
+        std::sort(sa.begin(), sa.end(), cmp);
+        tmp[sa[0]] = 0;
+        for (size_t i = 1; i < n; i++)
+            tmp[sa[i]] = tmp[sa[i - 1]] + (cmp(sa[i - 1], sa[i]) ? 1 : 0);
+        rank.swap(tmp);
+        if (rank[sa[n - 1]] == n - 1 || k >= n)
+            break;
+    }
+    return sa;
+}
+
+#endif // include guard, RLZ_SUFFIXSORT_H_INCLUDED
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* alphabet: compact a dictionary of wide symbols that only has a few
+ * distinct ones. Writes the sorted table of its symbols, and the dictionary
+ * as ranks in that table, in the fewest of 8, 16 or 32 bits that fit them;
+ * rlzparse and rlzunparse take both with --alphabet. Ranks sort like the
+ * symbols, so the dictionary's suffix array stays the same. The format is
+ * described in rlzcommon.h.
+ */
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "rlzcommon.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+void print_help() {
+    cerr << "Usage: alphabet [-w WIDTH] DICT_FILE ALPHABET_FILE RANKS_FILE\n"
+            "-w 16/24/32/40/48/64: symbol width of dictionary, default 64\n"
+            "Writes the dictionary's distinct symbols to ALPHABET_FILE, and the\n"
+            "dictionary as ranks among them to RANKS_FILE.\n";
+}
+
+template <typename R>
+void write_ranks(std::vector<R>* ranks, string output_file_name)
+{
+    std::ofstream outfile(output_file_name, std::ofstream::binary | std::ofstream::trunc);
+    outfile.write(reinterpret_cast<const char*>(ranks->data()), ranks->size() * sizeof(R));
+    if (!outfile) {
+        cerr << "Error: can't write " << output_file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+}
+
+template <typename T, typename R>
+void rank_dict(SymbolView<T> dict, Alphabet* alphabet, string ranks_file_name)
+{
+    std::vector<R> ranks(dict.size());
+    for (long long i = 0; i < dict.size(); i++)
+        ranks[i] = (R) alphabet->rank(dict[i]);
+    write_ranks(&ranks, ranks_file_name);
+}
+
+template <typename T>
+void build(string dict_file_name, string alphabet_file_name, string ranks_file_name)
+{
+    FileReader<T> dict_file(dict_file_name);
+    SymbolView<T> dict = dict_file.view();
+    std::vector<uint64_t> symbols(dict.data(), dict.data() + dict.size());
+    std::sort(symbols.begin(), symbols.end());
+    symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+
+    std::ofstream outfile(alphabet_file_name, std::ofstream::binary | std::ofstream::trunc);
+    outfile.write(reinterpret_cast<const char*>(symbols.data()), symbols.size() * sizeof(uint64_t));
+    outfile.close();
+    Alphabet alphabet;
+    if (!outfile || !alphabet.load(alphabet_file_name)) {
+        cerr << "Error: can't write " << alphabet_file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+
+    int width = alphabet.rank_width();
+    if (width == 0 || width >= (int) (8 * sizeof(T))) {
+        cerr << "Error: " << dict_file_name << " has " << alphabet.size()
+             << " distinct symbols, too many for ranks narrower than its symbols\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    switch (width) {
+        case 8: rank_dict<T, uint8_t>(dict, &alphabet, ranks_file_name); break;
+        case 16: rank_dict<T, uint16_t>(dict, &alphabet, ranks_file_name); break;
+        case 32: rank_dict<T, uint32_t>(dict, &alphabet, ranks_file_name); break;
+        default:
+            cerr << "bug: unknown rank width " << width << "\n";
+            exit(EXIT_BUG);
+    }
+    cerr << alphabet_file_name << ": " << alphabet.size() << " symbols; "
+         << ranks_file_name << ": " << dict.size() << " " << width << "-bit ranks, "
+         << (dict.size() * width / 8) << " bytes instead of " << dict.size() * sizeof(T) << "\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    int dict_width = 64;
+    string dict_file_name = "";
+    string alphabet_file_name = "";
+    string ranks_file_name = "";
+
+    int i = 1;
+    while (i < argc) {
+        string arg_i = string(argv[i]);
+        if (arg_i.compare("--help") == 0) {
+            print_help(); exit(0);
+        } else if (arg_i.compare("-w") == 0 || arg_i.compare("--width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            dict_width = atoi(argv[++i]);
+            if (!is_symbol_width(dict_width) || dict_width == 8) {
+                cerr << "Bad arguments: width wasn't 16, 24, 32, 40, 48, or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (dict_file_name.length() == 0) {
+            dict_file_name = arg_i;
+        } else if (alphabet_file_name.length() == 0) {
+            alphabet_file_name = arg_i;
+        } else if (ranks_file_name.length() == 0) {
+            ranks_file_name = arg_i;
+        } else {
+            cerr << "Bad arguments: too many filenames" << endl;
+            exit(EXIT_USER_ERROR);
+        }
+        i++;
+    }
+
+    if (ranks_file_name.length() == 0) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    switch (dict_width) {
+        case 16: build<uint16_t>(dict_file_name, alphabet_file_name, ranks_file_name); break;
+        case 24: build<packed24>(dict_file_name, alphabet_file_name, ranks_file_name); break;
+        case 32: build<uint32_t>(dict_file_name, alphabet_file_name, ranks_file_name); break;
+        case 40: build<packed40>(dict_file_name, alphabet_file_name, ranks_file_name); break;
+        case 48: build<packed48>(dict_file_name, alphabet_file_name, ranks_file_name); break;
+        case 64: build<uint64_t>(dict_file_name, alphabet_file_name, ranks_file_name); break;
+        default:
+            cerr << "bug: unknown dict_width=" << dict_width << "\n";
+            exit(EXIT_BUG);
+    }
+    return 0;
+}
@@ -41,6 +41,7 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include "rlzcommon.h"
 
 #ifndef VERSION_STRING
 #define VERSION_STRING "0.7.2"
@@ -228,7 +229,7 @@ void print_help() {
             "Options:\n"
             "  -n, --num-samples N    Default " << DEFAULT_N_SAMPLES << " samples.\n"
             "  -l, --sample-length L  Default " << DEFAULT_N_SAMPLES << " symbols per sample.\n"
-            "  -w, --width W          Bits per symbol, allowed values: 8, 16, 32, 64.\n"
+            "  -w, --width W          Bits per symbol, allowed values: 8, 16, 24, 32, 40, 48, 64.\n"
             "  -s, --random-seed S\n"
             "(builddict version " VERSION_STRING ", " DATE_STRING ")\n";
 }
@@ -286,8 +287,8 @@ int main(int argc, char* argv[]) {
             }
             i++;
             symbol_width_bits = atoi(argv[i]);
-            if ((symbol_width_bits != 8) && (symbol_width_bits != 16) && (symbol_width_bits != 32) && (symbol_width_bits != 64)) {
-                cerr << "Bad arguments: --width wasn't 8, 16, 32 or 64" << endl;
+            if (!is_symbol_width(symbol_width_bits)) {
+                cerr << "Bad arguments: --width wasn't 8, 16, 24, 32, 40, 48 or 64" << endl;
                 exit(127);
             }
         } else if (arg_i.compare("--outfile") == 0 || arg_i.compare("-o") == 0) {
@@ -371,6 +372,24 @@ int main(int argc, char* argv[]) {
             dg.work(quiet_mode);
             break;
         }
+        case 24:
+        {
+            DictionaryGenerator<packed24> dg = DictionaryGenerator<packed24>(input_file_name, output_file_name, n_samples, sample_length);
+            dg.work(quiet_mode);
+            break;
+        }
+        case 40:
+        {
+            DictionaryGenerator<packed40> dg = DictionaryGenerator<packed40>(input_file_name, output_file_name, n_samples, sample_length);
+            dg.work(quiet_mode);
+            break;
+        }
+        case 48:
+        {
+            DictionaryGenerator<packed48> dg = DictionaryGenerator<packed48>(input_file_name, output_file_name, n_samples, sample_length);
+            dg.work(quiet_mode);
+            break;
+        }
         case 64:
         {
             DictionaryGenerator<uint64_t> dg = DictionaryGenerator<uint64_t>(input_file_name, output_file_name, n_samples, sample_length);
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* bundle: put a dictionary and its suffix array into one .rlzdict file,
+ * with the symbol filter and (for 8- and 16-bit symbols) the k-mer table
+ * that rlzparse would otherwise have to build or do without, so that a
+ * deployed dictionary is one file that rlzparse and rlzunparse just map.
+ * The format is described in rlzcommon.h. The suffix array isn't checked;
+ * rlztools.checksa does that.
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "rlzcommon.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+void print_help() {
+    cerr << "Usage: bundle [-w WIDTH] [-W 32/64] [--plain] DICT_FILE SA_FILE OUTFILE\n"
+            "-w 8/16/24/32/40/48/64: symbol width of dictionary, default 8\n"
+            "-W 32/64: integer width of suffix array file, default 32\n"
+            "--plain: only the dictionary and suffix array, without rlzparse's tables\n"
+            "Suffix arrays are in platform-native byte order.\n";
+}
+
+/* The sections are written one after another, each padded to a multiple
+ * of RLZDICT_ALIGN bytes, and the header goes in the space left at the
+ * start once they're all there. */
+class BundleWriter {
+    std::ofstream out;
+    string file_name;
+    DictBundleHeader header;
+    uint64_t pos;
+
+public:
+    BundleWriter(string file_name, int symbol_width, int sa_width)
+        : out(file_name, std::ofstream::binary | std::ofstream::trunc),
+          file_name(file_name)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RLZDICT_MAGIC, sizeof(header.magic));
+        header.version = RLZDICT_VERSION;
+        header.symbol_width = symbol_width;
+        header.sa_width = sa_width;
+        pos = (sizeof(header) + RLZDICT_ALIGN - 1) / RLZDICT_ALIGN * RLZDICT_ALIGN;
+        out.seekp(pos);
+    }
+
+    void add(uint32_t type, uint32_t param, const void* data, uint64_t bytes)
+    {
+        DictBundleSection* s = &header.sections[header.n_sections++];
+        s->type = type;
+        s->param = param;
+        s->offset = pos;
+        s->length = bytes;
+        out.write(static_cast<const char*>(data), bytes);
+        uint64_t padding = (RLZDICT_ALIGN - bytes % RLZDICT_ALIGN) % RLZDICT_ALIGN;
+        std::vector<char> zeros(padding, 0);
+        out.write(zeros.data(), padding);
+        pos += bytes + padding;
+    }
+
+    uint64_t finish()
+    {
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.close();
+        if (!out) {
+            cerr << "Error: can't write " << file_name << "\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        return pos;
+    }
+};
+
+/* The k-mer table, as rlzcommon.h describes it: count the suffixes under
+ * each key, then sum up. The suffix array's order isn't needed for this,
+ * only that it's sorted. */
+template <typename T>
+std::vector<uint64_t> kmer_table(SymbolView<T> dict)
+{
+    int k = RLZDICT_KMER_BITS / (8 * sizeof(T));
+    int bits = sizeof(T) <= 2 ? 8 * sizeof(T) : 0; // k is 0 for wider ones
+    std::vector<uint64_t> table((1ULL << RLZDICT_KMER_BITS) + 1, 0);
+    for (long long p = 0; p < dict.size(); p++) {
+        uint64_t key = 0;
+        for (int j = 0; j < k; j++) {
+            key <<= bits;
+            if (p + j < dict.size()) key |= (uint64_t) dict[p + j];
+        }
+        table[key + 1]++;
+    }
+    for (size_t i = 1; i < table.size(); i++)
+        table[i] += table[i - 1];
+    return table;
+}
+
+template <typename T, typename S>
+void build(string dict_file_name, string sa_file_name, string output_file_name,
+           bool plain)
+{
+    FileReader<T> dict_file(dict_file_name);
+    FileReader<S> sa_file(sa_file_name, false, ALLOC_UNPACK_SA);
+    SymbolView<T> dict = dict_file.view();
+    if (sa_file.size() != dict.size()) {
+        cerr << "Error: " << sa_file_name << " has " << sa_file.size()
+             << " suffixes, but the dictionary has " << dict.size() << " symbols\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    BundleWriter out(output_file_name, 8 * sizeof(T), 8 * sizeof(S));
+    out.add(RLZDICT_DICT, 8 * sizeof(T), dict.data(), dict.size() * sizeof(T));
+    out.add(RLZDICT_SA, 8 * sizeof(S), sa_file.data(), sa_file.size() * sizeof(S));
+    string extras = "";
+    if (!plain) {
+        SymbolFilter<T> filter;
+        filter.build(dict);
+        SymbolView<uint64_t> words = filter.words();
+        out.add(RLZDICT_FILTER, 0, words.data(), words.size() * sizeof(uint64_t));
+        extras = ", symbol filter";
+        if (sizeof(T) <= 2) {
+            std::vector<uint64_t> table = kmer_table(dict);
+            out.add(RLZDICT_KMERS, RLZDICT_KMER_BITS / (8 * sizeof(T)),
+                    table.data(), table.size() * sizeof(uint64_t));
+            extras += ", k-mer table";
+        }
+    }
+    uint64_t bytes = out.finish();
+    cerr << output_file_name << ": " << dict.size() << " symbols, suffix array"
+         << extras << "; " << bytes << " bytes\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    int dict_width = 8;
+    int sa_width = 32;
+    bool plain = false;
+    string dict_file_name = "";
+    string sa_file_name = "";
+    string output_file_name = "";
+
+    int i = 1;
+    while (i < argc) {
+        string arg_i = string(argv[i]);
+        if (arg_i.compare("--help") == 0) {
+            print_help(); exit(0);
+        } else if (arg_i.compare("-w") == 0 || arg_i.compare("--width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            dict_width = atoi(argv[++i]);
+            if (!is_symbol_width(dict_width)) {
+                cerr << "Bad arguments: width wasn't 8, 16, 24, 32, 40, 48, or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("-W") == 0 || arg_i.compare("--sa-width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            sa_width = atoi(argv[++i]);
+            if ((sa_width != 32) && (sa_width != 64)) {
+                cerr << "Bad arguments: SA symbol width wasn't 32 or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("--plain") == 0) {
+            plain = true;
+        } else if (dict_file_name.length() == 0) {
+            dict_file_name = arg_i;
+        } else if (sa_file_name.length() == 0) {
+            sa_file_name = arg_i;
+        } else if (output_file_name.length() == 0) {
+            output_file_name = arg_i;
+        } else {
+            cerr << "Bad arguments: too many filenames" << endl;
+            exit(EXIT_USER_ERROR);
+        }
+        i++;
+    }
+
+    if (output_file_name.length() == 0) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    switch (dict_width) {
+        case 8:
+            if (sa_width == 32) build<uint8_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            else build<uint8_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            break;
+        case 16:
+            if (sa_width == 32) build<uint16_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            else build<uint16_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            break;
+        case 32:
+            if (sa_width == 32) build<uint32_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            else build<uint32_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            break;
+        case 24:
+            if (sa_width == 32) build<packed24, uint32_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            else build<packed24, uint64_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            break;
+        case 40:
+            if (sa_width == 32) build<packed40, uint32_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            else build<packed40, uint64_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            break;
+        case 48:
+            if (sa_width == 32) build<packed48, uint32_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            else build<packed48, uint64_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            break;
+        case 64:
+            if (sa_width == 32) build<uint64_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            else build<uint64_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, plain);
+            break;
+        default:
+            cerr << "bug: unknown dict_width=" << dict_width << "\n";
+            exit(EXIT_BUG);
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* checksa: check that a suffix array file is the suffix array of a
+ * dictionary, under the same --width and --sa-width as rlzparse would use.
+ * Exits with 0 if it is, or prints out what's wrong and exits with 1.
+ * rlzparse --verify-sa does the same checks before it starts parsing.
+ */
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include "rlzcommon.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+void print_help() {
+    cerr << "Usage: checksa [-w WIDTH] [-W 32/64] [-t threads] [-q] DICT_FILE SA_FILE\n"
+            "-w 8/16/24/32/40/48/64: symbol width of dictionary, default 8\n"
+            "-W 32/64: integer width of suffix array file, default 32\n"
+            "-t N: number of threads, default one per CPU\n"
+            "-q: print nothing if the suffix array is fine\n"
+            "Suffix array is interpreted in platform-native byte order.\n";
+}
+
+template <typename T, typename S>
+bool check(string dict_file_name, string sa_file_name, unsigned int threads,
+           bool quiet)
+{
+    FileReader<T> dict(dict_file_name);
+    FileReader<S> sa(sa_file_name, false, ALLOC_UNPACK_SA);
+    PhaseTime start = phase_time_now();
+    SACheckResult result = check_suffix_array(dict.view(), sa.view(), threads);
+    PhaseTime took = phase_time_since(start);
+    if (!result.ok()) {
+        print_sa_check_errors(&result);
+        return false;
+    }
+    if (!quiet) {
+        cerr << sa_file_name << ": " << sa.size() << " suffixes ok ("
+             << std::fixed << std::setprecision(2) << took.wall << " s)\n";
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    int dict_width = 8;
+    int sa_width = 32;
+    unsigned int threads = std::thread::hardware_concurrency();
+    bool quiet = false;
+    string dict_file_name = "";
+    string sa_file_name = "";
+
+    int i = 1;
+    while (i < argc) {
+        string arg_i = string(argv[i]);
+        if (arg_i.compare("--help") == 0) {
+            print_help(); exit(0);
+        } else if (arg_i.compare("-q") == 0 || arg_i.compare("--quiet") == 0) {
+            quiet = true;
+        } else if (arg_i.compare("-w") == 0 || arg_i.compare("--width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            dict_width = atoi(argv[++i]);
+            if (!is_symbol_width(dict_width)) {
+                cerr << "Bad arguments: width wasn't 8, 16, 24, 32, 40, 48, or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("-W") == 0 || arg_i.compare("--sa-width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            sa_width = atoi(argv[++i]);
+            if ((sa_width != 32) && (sa_width != 64)) {
+                cerr << "Bad arguments: SA symbol width wasn't 32 or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("-t") == 0 || arg_i.compare("--threads") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no thread count given after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            int t = atoi(argv[++i]);
+            if (t <= 0) {
+                cerr << "Bad arguments: thread count must be positive\n";
+                exit(EXIT_USER_ERROR);
+            }
+            threads = (unsigned int) t;
+        } else if (dict_file_name.length() == 0) {
+            dict_file_name = arg_i;
+        } else if (sa_file_name.length() == 0) {
+            sa_file_name = arg_i;
+        } else {
+            cerr << "Bad arguments: too many filenames" << endl;
+            exit(EXIT_USER_ERROR);
+        }
+        i++;
+    }
+
+    if (dict_file_name.length() == 0 || sa_file_name.length() == 0) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    bool ok = false;
+    switch (dict_width) {
+        case 8:
+            ok = sa_width == 32 ? check<uint8_t, uint32_t>(dict_file_name, sa_file_name, threads, quiet)
+                                : check<uint8_t, uint64_t>(dict_file_name, sa_file_name, threads, quiet);
+            break;
+        case 16:
+            ok = sa_width == 32 ? check<uint16_t, uint32_t>(dict_file_name, sa_file_name, threads, quiet)
+                                : check<uint16_t, uint64_t>(dict_file_name, sa_file_name, threads, quiet);
+            break;
+        case 32:
+            ok = sa_width == 32 ? check<uint32_t, uint32_t>(dict_file_name, sa_file_name, threads, quiet)
+                                : check<uint32_t, uint64_t>(dict_file_name, sa_file_name, threads, quiet);
+            break;
+        case 24:
+            ok = sa_width == 32 ? check<packed24, uint32_t>(dict_file_name, sa_file_name, threads, quiet)
+                                : check<packed24, uint64_t>(dict_file_name, sa_file_name, threads, quiet);
+            break;
+        case 40:
+            ok = sa_width == 32 ? check<packed40, uint32_t>(dict_file_name, sa_file_name, threads, quiet)
+                                : check<packed40, uint64_t>(dict_file_name, sa_file_name, threads, quiet);
+            break;
+        case 48:
+            ok = sa_width == 32 ? check<packed48, uint32_t>(dict_file_name, sa_file_name, threads, quiet)
+                                : check<packed48, uint64_t>(dict_file_name, sa_file_name, threads, quiet);
+            break;
+        case 64:
+            ok = sa_width == 32 ? check<uint64_t, uint32_t>(dict_file_name, sa_file_name, threads, quiet)
+                                : check<uint64_t, uint64_t>(dict_file_name, sa_file_name, threads, quiet);
+            break;
+        default:
+            cerr << "bug: unknown dict_width=" << dict_width << "\n";
+            exit(EXIT_BUG);
+    }
+    return ok ? 0 : EXIT_INVALID_INPUT;
+}
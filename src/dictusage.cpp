@@ -0,0 +1,317 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* dictusage: find out which parts of a dictionary a set of RLZ files use.
+ *
+ * Usage:
+ * dictusage -d DICTIONARY [-l sample-length] [-n samples] [-w 8|16|32|64]
+ *           [-f 32x2|64x2|vbyte|ascii|delta] [-t threads] [-o outfile]
+ *           [--literal-runs] [--bitmap FILE] FILE.rlz...
+ *
+ * The dictionary is taken to be builddict's output, n samples of l symbols
+ * each, back to back; every phrase in every RLZ file is mapped onto those
+ * samples, and one line per sample is written out:
+ *   sample start refs symbols covered
+ * where refs is the number of phrases starting in the sample, symbols the
+ * number of symbols copied out of it in total, and covered the number of
+ * its symbols that were copied at least once. Samples with a refs of zero
+ * are dead weight and the first ones to replace when building the next
+ * dictionary. --bitmap writes the coverage of each symbol as a bitmap, in
+ * the format of CoverageBitmap::write().
+ *
+ * Only the size of the dictionary is needed, not its contents. The RLZ
+ * files are spread over the threads, one whole file at a time, and each
+ * thread keeps its own counts until the end.
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+#include "rlzcommon.h"
+
+// Same as in builddict.
+#define DEFAULT_SAMPLE_LENGTH 128
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+
+void print_help() {
+    cerr << "dictusage: count references to each dictionary sample in RLZ files.\n"
+            "Usage: dictusage [options] -d DICTIONARY FILE.rlz...\n"
+            "Options:\n"
+            "  -l, --sample-length L\tSymbols per builddict sample, default "
+         << DEFAULT_SAMPLE_LENGTH << ".\n"
+            "  -n, --num-samples N\tCheck that the dictionary has N samples.\n"
+            "  -w, --width 8/16/32/64\tBit width of dictionary symbols, default=8.\n"
+            "  -f, --input-fmt 32x2/64x2/vbyte/ascii/delta\tFormat of RLZ files, default=32x2.\n"
+            "  --literal-runs\tThe files were made with rlzparse --literal-runs.\n"
+            "  -t, --threads N\tFiles to read at once; default is one per CPU.\n"
+            "  -o, --outfile FILE\tWrite the per-sample counts here, not to stdout.\n"
+            "  --bitmap FILE\tAlso write a bitmap of referenced dictionary symbols.\n"
+            "  -q, --quiet\tDon't print a summary on stderr.\n";
+}
+
+// One thread's counts, indexed by sample.
+struct UsageCounts {
+    vector<uint64_t> refs;
+    vector<uint64_t> symbols;
+    uint64_t tokens;
+    uint64_t out_of_range; // phrases that run past the end of the dictionary
+
+    UsageCounts(size_t n_samples)
+        : refs(n_samples), symbols(n_samples), tokens(0), out_of_range(0) {}
+};
+
+static void count_file(string file_name, int input_mode, int literal_width,
+                       uint64_t dict_size, uint64_t sample_length,
+                       UsageCounts* c, CoverageBitmap* coverage)
+{
+    MappedFile file(file_name);
+    RLZBufferReader reader(file.data(), file.data() + file.size(), input_mode);
+    reader.literal_width = literal_width;
+    RLZToken tok;
+    while (reader.next(&tok) > 0) {
+        c->tokens++;
+        if (tok.length == 0) continue; // literal, or a run of them
+        uint64_t from = tok.start_pos, to = tok.start_pos + tok.length;
+        if (to > dict_size || to < from) {
+            c->out_of_range++;
+            to = dict_size;
+            if (from >= to) continue;
+        }
+        c->refs[from / sample_length]++;
+        for (uint64_t s = from / sample_length; s * sample_length < to; s++) {
+            uint64_t lo = from > s * sample_length ? from : s * sample_length;
+            uint64_t hi = to < (s + 1) * sample_length ? to : (s + 1) * sample_length;
+            c->symbols[s] += hi - lo;
+        }
+        coverage->mark(from, to);
+    }
+}
+
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    string dict_file_name = "";
+    string output_file_name = "";
+    string bitmap_file_name = "";
+    vector<string> input_file_names;
+    int symbol_width_bits = 8;
+    string input_format = "32x2";
+    int input_mode = FMT_32X2;
+    long long sample_length = DEFAULT_SAMPLE_LENGTH;
+    long long n_samples_expected = 0;
+    unsigned int n_threads = std::thread::hardware_concurrency();
+    bool quiet = false;
+    bool literal_runs = false;
+
+    /* Argument parsing *****/
+    int i = 1;
+    while (i < argc) {
+        string arg_i = string(argv[i]);
+        bool has_value = argc >= i + 2;
+        if (arg_i.compare("--help") == 0) {
+            print_help(); exit(0);
+        } else if (arg_i.compare("-q") == 0 || arg_i.compare("--quiet") == 0) {
+            quiet = true;
+        } else if (arg_i.compare("--literal-runs") == 0) {
+            literal_runs = true;
+        } else if (arg_i.compare("-d") == 0 || arg_i.compare("--dict") == 0 || arg_i.compare("--dictionary") == 0) {
+            if (!has_value) {
+                cerr << "Bad arguments: no filename after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            dict_file_name = string(argv[++i]);
+        } else if (arg_i.compare("-o") == 0 || arg_i.compare("--outfile") == 0) {
+            if (!has_value) {
+                cerr << "Bad arguments: no filename after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            output_file_name = string(argv[++i]);
+        } else if (arg_i.compare("--bitmap") == 0) {
+            if (!has_value) {
+                cerr << "Bad arguments: no filename after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            bitmap_file_name = string(argv[++i]);
+        } else if (arg_i.compare("-l") == 0 || arg_i.compare("--sample-length") == 0
+                   || arg_i.compare("-n") == 0 || arg_i.compare("--num-samples") == 0) {
+            if (!has_value) {
+                cerr << "Bad arguments: no number after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            long long n = atoll(argv[++i]);
+            if (n <= 0) {
+                cerr << "Bad arguments: " << arg_i << " must be positive\n";
+                exit(EXIT_USER_ERROR);
+            }
+            if (arg_i.compare("-l") == 0 || arg_i.compare("--sample-length") == 0)
+                sample_length = n;
+            else
+                n_samples_expected = n;
+        } else if (arg_i.compare("-w") == 0 || arg_i.compare("--width") == 0) {
+            if (!has_value) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            symbol_width_bits = atoi(argv[++i]);
+            if ((symbol_width_bits != 8) && (symbol_width_bits != 16) && (symbol_width_bits != 32) && (symbol_width_bits != 64)) {
+                cerr << "Bad arguments: width wasn't 8, 16, 32, or 64\n";
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("-f") == 0 || arg_i.compare("--input-fmt") == 0) {
+            if (!has_value) {
+                cerr << "Bad arguments: no input format after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            input_format = string(argv[++i]);
+        } else if (arg_i.compare("-t") == 0 || arg_i.compare("--threads") == 0) {
+            if (!has_value) {
+                cerr << "Bad arguments: no thread count given after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            int t = atoi(argv[++i]);
+            if (t <= 0) {
+                cerr << "Bad arguments: thread count must be positive\n";
+                exit(EXIT_USER_ERROR);
+            }
+            n_threads = (unsigned int) t;
+        } else if (arg_i.length() > 1 && arg_i[0] == '-') {
+            cerr << "Unknown argument '" << arg_i << "'\n";
+            exit(EXIT_USER_ERROR);
+        } else {
+            input_file_names.push_back(arg_i);
+        }
+        i++;
+    }
+
+    if (dict_file_name.length() == 0) {
+        cerr << "Bad arguments: dictionary file name not specified\n";
+        exit(EXIT_USER_ERROR);
+    }
+    if (input_file_names.empty()) {
+        cerr << "Bad arguments: no RLZ files given\n";
+        exit(EXIT_USER_ERROR);
+    }
+    if (input_format.compare("32x2") == 0) {
+        input_mode = FMT_32X2;
+    } else if (input_format.compare("64x2") == 0) {
+        input_mode = FMT_64X2;
+    } else if (input_format.compare("vbyte") == 0) {
+        input_mode = FMT_VBYTE;
+    } else if (input_format.compare("ascii") == 0) {
+        input_mode = FMT_ASCII;
+    } else if (input_format.compare("delta") == 0) {
+        input_mode = FMT_DELTA;
+    } else {
+        cerr << "Bad arguments: input format not \"32x2\", \"64x2\", \"vbyte\", \"ascii\" or \"delta\".\n";
+        exit(EXIT_USER_ERROR);
+    }
+    /* end argument parsing *****/
+
+    ifstream dict_file(dict_file_name, ifstream::binary);
+    if (!dict_file) {
+        cerr << "Error: can't open dictionary file " << dict_file_name << endl;
+        exit(EXIT_INVALID_INPUT);
+    }
+    uint64_t dict_size = file_size(&dict_file) / (symbol_width_bits / 8);
+    dict_file.close();
+    size_t n_samples = (dict_size + sample_length - 1) / sample_length;
+    if (dict_size % sample_length != 0)
+        cerr << "Warning: dictionary size " << dict_size << " isn't a multiple of "
+             << sample_length << "; the last sample is shorter\n";
+    if (n_samples_expected > 0 && (size_t) n_samples_expected != n_samples) {
+        cerr << "Error: dictionary has " << n_samples << " samples of " << sample_length
+             << " symbols, not " << n_samples_expected << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+
+    if (n_threads == 0) n_threads = 1;
+    if (n_threads > input_file_names.size())
+        n_threads = input_file_names.size();
+    CoverageBitmap coverage(dict_size);
+    vector<UsageCounts> counts(n_threads, UsageCounts(n_samples));
+    std::atomic<size_t> next_file(0);
+    vector<std::thread> threads;
+    for (unsigned int t = 0; t < n_threads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            size_t f;
+            while ((f = next_file.fetch_add(1)) < input_file_names.size())
+                count_file(input_file_names[f], input_mode,
+                           literal_runs ? symbol_width_bits / 8 : 0, dict_size,
+                           sample_length, &counts[t], &coverage);
+        }));
+    }
+    for (std::thread& th : threads) th.join();
+    for (unsigned int t = 1; t < n_threads; t++) {
+        for (size_t s = 0; s < n_samples; s++) {
+            counts[0].refs[s] += counts[t].refs[s];
+            counts[0].symbols[s] += counts[t].symbols[s];
+        }
+        counts[0].tokens += counts[t].tokens;
+        counts[0].out_of_range += counts[t].out_of_range;
+    }
+    UsageCounts* total = &counts[0];
+
+    ofstream output_file;
+    if (output_file_name.length() > 0) {
+        output_file.open(output_file_name, ofstream::trunc);
+        if (!output_file) {
+            cerr << "Error: can't open output file " << output_file_name << endl;
+            exit(EXIT_USER_ERROR);
+        }
+    }
+    std::ostream& out = output_file_name.length() > 0 ? output_file : cout;
+    size_t unused = 0;
+    out << "# " << dict_file_name << ": " << n_samples << " samples of "
+        << sample_length << " symbols, " << input_file_names.size() << " RLZ files\n"
+        << "# sample start refs symbols covered\n";
+    for (size_t s = 0; s < n_samples; s++) {
+        uint64_t start = s * sample_length;
+        uint64_t end = start + sample_length < dict_size ? start + sample_length : dict_size;
+        out << s << " " << start << " " << total->refs[s] << " "
+            << total->symbols[s] << " " << coverage.count(start, end) << "\n";
+        if (total->refs[s] == 0) unused++;
+    }
+    out.flush();
+    if (!out) {
+        cerr << "Error: writing output failed\n";
+        exit(EXIT_USER_ERROR);
+    }
+
+    if (bitmap_file_name.length() > 0) {
+        ofstream bitmap_file(bitmap_file_name, ofstream::binary | ofstream::trunc);
+        if (!bitmap_file || !coverage.write(bitmap_file)) {
+            cerr << "Error: can't write bitmap file " << bitmap_file_name << endl;
+            exit(EXIT_USER_ERROR);
+        }
+    }
+
+    if (total->out_of_range > 0)
+        cerr << "Warning: " << total->out_of_range
+             << " phrases run past the end of the dictionary\n";
+    if (!quiet) {
+        uint64_t covered = coverage.count(0, dict_size);
+        cerr << total->tokens << " tokens in " << input_file_names.size() << " files; "
+             << unused << " of " << n_samples << " samples unreferenced, "
+             << covered << " of " << dict_size << " symbols covered\n";
+    }
+    return 0;
+}
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* packsa: pack a suffix array into the smaller format described in
+ * rlzcommon.h, which rlzparse --sa (and the other tools that read suffix
+ * arrays) unpack on load, or with --unpack turn one back into a plain
+ * suffix array. Only whole suffix arrays can be packed, not the sparse
+ * ones of rlztools.sparsesa. The suffix array isn't checked beyond its
+ * entries being in range; rlztools.checksa does that, on either kind.
+ */
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include "rlzcommon.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+void print_help() {
+    cerr << "Usage: packsa [-W 32/64] [--unpack] SA_FILE OUTFILE\n"
+            "-W 32/64: integer width of suffix array file, default 32\n"
+            "--unpack: turn a packed suffix array back into a plain one\n"
+            "Suffix arrays are in platform-native byte order.\n";
+}
+
+template <typename S>
+void pack(string sa_file_name, string output_file_name)
+{
+    if (is_packed_sa(sa_file_name)) {
+        cerr << "Error: " << sa_file_name << " is packed already\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    FileReader<S> sa_file(sa_file_name);
+    SymbolView<S> sa = sa_file.view();
+    for (long long i = 0; i < sa.size(); i++) {
+        if ((long long) sa[i] >= sa.size()) {
+            cerr << "Error: " << sa_file_name << " has " << sa[i] << " at " << i
+                 << ", but only " << sa.size() << " suffixes; is it a sparse suffix array?\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+    }
+    std::ofstream outfile(output_file_name, std::ofstream::binary | std::ofstream::trunc);
+    if (!write_packed_sa(sa, outfile)) {
+        cerr << "Error: can't write " << output_file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    long long bytes = outfile.tellp();
+    cerr << output_file_name << ": " << sa.size() << " suffixes, " << bytes << " bytes ("
+         << (sa.size() > 0 ? 100 * bytes / (sa.size() * (long long) sizeof(S)) : 0)
+         << "% of " << sa_file_name << ")\n";
+}
+
+template <typename S>
+void unpack(string sa_file_name, string output_file_name)
+{
+    if (!is_packed_sa(sa_file_name)) {
+        cerr << "Error: " << sa_file_name << " isn't a packed suffix array\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    FileReader<S> sa_file(sa_file_name, false, ALLOC_UNPACK_SA);
+    std::ofstream outfile(output_file_name, std::ofstream::binary | std::ofstream::trunc);
+    outfile.write(reinterpret_cast<const char*>(sa_file.data()), sa_file.size() * sizeof(S));
+    if (!outfile) {
+        cerr << "Error: can't write " << output_file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    cerr << output_file_name << ": " << sa_file.size() << " suffixes, unpacked in "
+         << sa_file.load_time.wall << " s\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    int sa_width = 32;
+    bool unpacking = false;
+    string sa_file_name = "";
+    string output_file_name = "";
+
+    int i = 1;
+    while (i < argc) {
+        string arg_i = string(argv[i]);
+        if (arg_i.compare("--help") == 0) {
+            print_help(); exit(0);
+        } else if (arg_i.compare("-W") == 0 || arg_i.compare("--sa-width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            sa_width = atoi(argv[++i]);
+            if ((sa_width != 32) && (sa_width != 64)) {
+                cerr << "Bad arguments: SA symbol width wasn't 32 or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("--unpack") == 0) {
+            unpacking = true;
+        } else if (sa_file_name.length() == 0) {
+            sa_file_name = arg_i;
+        } else if (output_file_name.length() == 0) {
+            output_file_name = arg_i;
+        } else {
+            cerr << "Bad arguments: too many filenames" << endl;
+            exit(EXIT_USER_ERROR);
+        }
+        i++;
+    }
+
+    if (output_file_name.length() == 0) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    if (unpacking) {
+        if (sa_width == 32) unpack<uint32_t>(sa_file_name, output_file_name);
+        else unpack<uint64_t>(sa_file_name, output_file_name);
+    } else {
+        if (sa_width == 32) pack<uint32_t>(sa_file_name, output_file_name);
+        else pack<uint64_t>(sa_file_name, output_file_name);
+    }
+    return 0;
+}
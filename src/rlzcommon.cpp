@@ -10,11 +10,33 @@
 #include "rlzcommon.h"
 #include <iostream>
 #include <iomanip>
+#include <cctype>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <fstream>
+#include <limits>
 #include <sstream>
 #include <string>
+#include <map>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
+
+// From <linux/mempolicy.h>, which isn't always installed.
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
 
 using std::string;
 using std::ifstream;
@@ -35,18 +57,440 @@ long file_size(std::ifstream* ifs) {
     return size;
 }
 
+int length_histogram_bucket(int64_t length) {
+    int bucket = 0;
+    while (length > 0 && bucket < LENGTH_HISTOGRAM_BUCKETS - 1) {
+        length >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+PhaseTime phase_time_now() {
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    PhaseTime t;
+    t.wall = wall.tv_sec + wall.tv_nsec / 1e9;
+    t.cpu = cpu.tv_sec + cpu.tv_nsec / 1e9;
+    return t;
+}
+
+PhaseTime phase_time_since(PhaseTime start) {
+    PhaseTime now = phase_time_now();
+    now.wall -= start.wall;
+    now.cpu -= start.cpu;
+    return now;
+}
+
+long long current_rss_bytes() {
+    ifstream statm("/proc/self/statm");
+    long long total_pages, resident_pages;
+    if (!(statm >> total_pages >> resident_pages))
+        return -1;
+    return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+/***** Alphabet *****/
+
+bool Alphabet::load(std::string file_name)
+{
+    ifstream in(file_name, ifstream::binary);
+    if (!in) return false;
+    symbols.resize(file_size(&in) / sizeof(uint64_t));
+    in.read(reinterpret_cast<char*>(symbols.data()), symbols.size() * sizeof(uint64_t));
+    if (!in) return false;
+    for (size_t i = 1; i < symbols.size(); i++)
+        if (symbols[i - 1] >= symbols[i]) return false;
+    // Too many for 32-bit ranks; rank_width() says so, and rank() isn't used.
+    if (symbols.size() >= UINT32_MAX) return true;
+    uint64_t n_slots = 1;
+    while (n_slots < 2 * symbols.size()) n_slots <<= 1;
+    slots.assign(n_slots, 0);
+    slot_mask = n_slots - 1;
+    for (size_t r = 0; r < symbols.size(); r++) {
+        uint64_t i = mix64(symbols[r]) & slot_mask;
+        while (slots[i] != 0) i = (i + 1) & slot_mask;
+        slots[i] = r + 1;
+    }
+    return true;
+}
+
+/***** Packed suffix arrays *****/
+
+template <typename S>
+bool write_packed_sa(SymbolView<S> sa, std::ostream& out)
+{
+    uint64_t n = sa.size();
+    PackedSAHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKED_SA_MAGIC, sizeof(header.magic));
+    header.n = n;
+    header.block_entries = PACKED_SA_BLOCK;
+    header.sample_rate = PACKED_SA_SAMPLE;
+
+    std::vector<S> isa(n);
+    for (uint64_t i = 0; i < n; i++) isa[sa[i]] = (S) i;
+    std::vector<uint64_t> samples;
+    for (uint64_t p = 0; p < n; p += PACKED_SA_SAMPLE) samples.push_back(isa[p]);
+
+    uint64_t n_blocks = (n + PACKED_SA_BLOCK - 1) / PACKED_SA_BLOCK;
+    std::vector<PackedSABlock> blocks(n_blocks);
+    std::vector<char> codes;
+    char buf[10];
+    auto put = [&](uint64_t x) {
+        int len = 0;
+        while (x >= 0x80) {
+            buf[len++] = (char) ((x & 0x7F) | 0x80);
+            x >>= 7;
+        }
+        buf[len++] = (char) x;
+        codes.insert(codes.end(), buf, buf + len);
+    };
+    for (uint64_t b = 0; b < n_blocks; b++) {
+        uint64_t begin = b * PACKED_SA_BLOCK;
+        uint64_t end = begin + PACKED_SA_BLOCK < n ? begin + PACKED_SA_BLOCK : n;
+        uint64_t prev = sa[begin] + 1 < n ? isa[sa[begin] + 1] : isa[0];
+        blocks[b].offset = codes.size();
+        blocks[b].first = prev;
+        uint64_t run = 0; // differences of 1 not yet written
+        for (uint64_t i = begin + 1; i < end; i++) {
+            uint64_t psi = sa[i] + 1 < n ? isa[sa[i] + 1] : isa[0];
+            if (psi == prev + 1) {
+                run++;
+            } else {
+                if (run > 0) put(((run - 1) << 1) | 1);
+                run = 0;
+                put(zigzag_encode((int64_t) (psi - prev)) << 1);
+            }
+            prev = psi;
+        }
+        if (run > 0) put(((run - 1) << 1) | 1);
+    }
+
+    uint64_t codes_start = sizeof(header) + n_blocks * sizeof(PackedSABlock)
+                           + samples.size() * sizeof(uint64_t);
+    for (PackedSABlock& block : blocks) block.offset += codes_start;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(blocks.data()), n_blocks * sizeof(PackedSABlock));
+    out.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(uint64_t));
+    out.write(codes.data(), codes.size());
+    return (bool) out;
+}
+
+template bool write_packed_sa<uint32_t>(SymbolView<uint32_t>, std::ostream&);
+template bool write_packed_sa<uint64_t>(SymbolView<uint64_t>, std::ostream&);
+
+bool is_packed_sa(FileSection file)
+{
+    ifstream in(file.file_name, ifstream::binary);
+    char magic[8];
+    in.seekg(file.offset);
+    if (!in.read(magic, sizeof(magic))) return false;
+    return memcmp(magic, PACKED_SA_MAGIC, sizeof(magic)) == 0;
+}
+
+/* Unpacks the packed suffix array in [buf, buf+len) into out, which has
+ * room for its n entries; false if it doesn't hold together. First the
+ * blocks are decoded into out as psi, then it's walked from the samples,
+ * each thread taking some of both. On a damaged file the walks might
+ * trample over each other, but never outside out, and the check at the
+ * end of each walk (that it arrived at the next sample) will fail. */
+#define PACKED_SA_WALKS 16 // walks each thread takes at a time
+
+template <typename T>
+static bool unpack_sa(const char* buf, uint64_t len, T* out)
+{
+    PackedSAHeader header;
+    if (len < sizeof(header)) return false;
+    memcpy(&header, buf, sizeof(header));
+    uint64_t n = header.n;
+    if (n == 0) return true;
+    if (header.block_entries == 0 || header.sample_rate == 0) return false;
+    uint64_t n_blocks = (n - 1) / header.block_entries + 1;
+    uint64_t n_samples = (n - 1) / header.sample_rate + 1;
+    if ((len - sizeof(header)) / sizeof(PackedSABlock) < n_blocks
+        || (len - sizeof(header) - n_blocks * sizeof(PackedSABlock)) / sizeof(uint64_t) < n_samples)
+        return false;
+    std::vector<PackedSABlock> blocks(n_blocks);
+    memcpy(blocks.data(), buf + sizeof(header), n_blocks * sizeof(PackedSABlock));
+    std::vector<uint64_t> samples(n_samples);
+    memcpy(samples.data(), buf + sizeof(header) + n_blocks * sizeof(PackedSABlock),
+           n_samples * sizeof(uint64_t));
+
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    std::atomic<bool> bad(false);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            for (uint64_t b = n_blocks * t / threads; b < n_blocks * (t + 1) / threads; b++) {
+                uint64_t i = b * header.block_entries;
+                uint64_t end = n - i > header.block_entries ? i + header.block_entries : n;
+                uint64_t pos = blocks[b].offset;
+                uint64_t stop = b + 1 < n_blocks ? blocks[b + 1].offset : len;
+                uint64_t psi = blocks[b].first;
+                if (stop > len || pos > stop || psi >= n) { bad = true; return; }
+                out[i++] = (T) psi;
+                while (i < end) {
+                    uint64_t x = 0;
+                    for (int shift = 0; ; shift += 7) {
+                        if (pos == stop || shift > 63) { bad = true; return; }
+                        uint64_t c = (uint8_t) buf[pos++];
+                        x |= (c & 0x7F) << shift;
+                        if (!(c & 0x80)) break;
+                    }
+                    if (x & 1) {
+                        uint64_t run = (x >> 1) + 1;
+                        if (run > end - i || psi + run >= n) { bad = true; return; }
+                        while (run-- > 0) out[i++] = (T) ++psi;
+                    } else {
+                        psi += zigzag_decode(x >> 1);
+                        if (psi >= n) { bad = true; return; }
+                        out[i++] = (T) psi;
+                    }
+                }
+            }
+        }));
+    }
+    for (std::thread& w : workers) w.join();
+    if (bad) return false;
+
+    workers.clear();
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            uint64_t first = n_samples * t / threads, last = n_samples * (t + 1) / threads;
+            for (uint64_t k0 = first; k0 < last; k0 += PACKED_SA_WALKS) {
+                // Each walk's next step waits on a cache miss; take several
+                // at a time, so that the misses overlap.
+                uint64_t walks = last - k0 < PACKED_SA_WALKS ? last - k0 : PACKED_SA_WALKS;
+                uint64_t p[PACKED_SA_WALKS], end[PACKED_SA_WALKS], rank[PACKED_SA_WALKS];
+                for (uint64_t w = 0; w < walks; w++) {
+                    p[w] = (k0 + w) * header.sample_rate;
+                    end[w] = n - p[w] > header.sample_rate ? p[w] + header.sample_rate : n;
+                    rank[w] = samples[k0 + w];
+                }
+                for (uint64_t step = 0; step < header.sample_rate; step++) {
+                    for (uint64_t w = 0; w < walks; w++) {
+                        if (p[w] == end[w]) continue;
+                        if (rank[w] >= n) { bad = true; return; }
+                        uint64_t next = out[rank[w]];
+                        out[rank[w]] = (T) p[w]++;
+                        rank[w] = next;
+                    }
+                }
+                for (uint64_t w = 0; w < walks; w++) {
+                    uint64_t k = k0 + w;
+                    if (rank[w] != samples[k + 1 < n_samples ? k + 1 : 0]) { bad = true; return; }
+                }
+            }
+        }));
+    }
+    for (std::thread& w : workers) w.join();
+    return !bad;
+}
+
 /***** FileReader *****/
 
+static size_t round_up(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+/* The NUMA nodes listed in /sys/devices/system/node/online (which looks
+ * like "0-1" or "0,2-3"), as a bitmask. 0 if there is no such file, or the
+ * machine somehow has more nodes than there are bits in a long. */
+static unsigned long online_numa_nodes()
+{
+    ifstream online("/sys/devices/system/node/online");
+    string list;
+    if (!(online >> list)) return 0;
+    std::istringstream ranges(list);
+    string range;
+    unsigned long mask = 0;
+    while (std::getline(ranges, range, ',')) {
+        int lo = -1, hi = -1;
+        if (sscanf(range.c_str(), "%d-%d", &lo, &hi) == 1)
+            hi = lo;
+        if (lo < 0 || hi >= (int) (sizeof(mask) * CHAR_BIT))
+            return 0;
+        for (int node = lo; node <= hi; node++)
+            mask |= 1UL << node;
+    }
+    return mask;
+}
+
+/* Sets a MPOL_INTERLEAVE memory policy on [addr, addr+len), so that its
+ * pages get spread round-robin over every online NUMA node as they are
+ * first touched. Returns false if that didn't work, or isn't Linux.
+ * This is the raw mbind() system call rather than libnuma's wrapper, so
+ * that we don't need to link against anything. */
+static bool numa_interleave(void* addr, size_t len)
+{
+#ifdef SYS_mbind
+    unsigned long nodes = online_numa_nodes();
+    if (nodes == 0) return false;
+    // The kernel only looks at the first maxnode-1 bits of the mask.
+    unsigned long maxnode = sizeof(nodes) * CHAR_BIT;
+    return syscall(SYS_mbind, addr, len, MPOL_INTERLEAVE, &nodes, maxnode, 0) == 0;
+#else
+    (void) addr; (void) len;
+    return false;
+#endif
+}
+
+/* Asks the kernel which NUMA node each page of [addr, addr+len) is on,
+ * and returns a summary like "node 0: 50%, node 1: 50%". Looks at no more
+ * than a few thousand evenly spaced pages, which is plenty for a summary.
+ * move_pages() with a null node list doesn't move anything, it just
+ * reports where the pages are. */
+static string numa_placement(const void* addr, size_t len)
+{
+#ifdef SYS_move_pages
+    const size_t max_samples = 4096;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t n_pages = (len + page_size - 1) / page_size;
+    size_t n_samples = n_pages < max_samples ? n_pages : max_samples;
+    if (n_samples == 0) return "";
+    std::vector<void*> pages(n_samples);
+    std::vector<int> status(n_samples, -1);
+    for (size_t i = 0; i < n_samples; i++) {
+        size_t page = i * n_pages / n_samples;
+        pages[i] = (char*) addr + page * page_size;
+    }
+    if (syscall(SYS_move_pages, 0, n_samples, pages.data(), NULL,
+                status.data(), 0) != 0)
+        return "";
+    std::map<int, size_t> per_node;
+    for (int node : status)
+        if (node >= 0) per_node[node]++;
+    ostringstream os;
+    for (auto it = per_node.begin(); it != per_node.end(); it++) {
+        if (it != per_node.begin()) os << ", ";
+        os << "node " << it->first << ": "
+           << (it->second * 100 / n_samples) << "%";
+    }
+    return os.str();
+#else
+    (void) addr; (void) len;
+    return "";
+#endif
+}
+
+/* Returns memory for FileReader's array, or NULL if a plain new[] should be
+ * used (ALLOC_HEAP, or huge pages not being available at all).
+ * *mode is updated to the mode we ended up with, and *alloc_bytes to the
+ * size of the allocation, which is rounded up to a whole huge page. */
+static void* allocate_array(size_t bytes, int* mode, size_t* alloc_bytes)
+{
+    int flags = *mode & ~ALLOC_MODE_MASK;
+    int kind = *mode & ALLOC_MODE_MASK;
+    void* p = NULL;
+    *alloc_bytes = bytes;
+    if (bytes == 0) {
+        *mode = ALLOC_HEAP;
+        return NULL;
+    }
+    size_t rounded = round_up(bytes, HUGE_PAGE_SIZE);
+    if (kind == ALLOC_HUGETLB) {
+#ifdef MAP_HUGETLB
+        p = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) p = NULL;
+#endif
+        if (p == NULL) {
+            if (!(flags & ALLOC_QUIET))
+                cerr << "Warning: couldn't get " << (rounded >> 20) << " MiB of "
+                        "hugetlbfs pages (is vm.nr_hugepages big enough?),\n"
+                        "falling back to transparent huge pages.\n";
+            kind = ALLOC_HUGEPAGE;
+        }
+    }
+    if (p == NULL && kind == ALLOC_HUGEPAGE) {
+        if (posix_memalign(&p, HUGE_PAGE_SIZE, rounded) == 0) {
+#ifdef MADV_HUGEPAGE
+            // Must happen before the pages are first touched by read().
+            madvise(p, rounded, MADV_HUGEPAGE);
+#endif
+        } else {
+            p = NULL;
+            kind = ALLOC_HEAP;
+        }
+    }
+    if (p == NULL && (flags & ALLOC_NUMA_INTERLEAVE)) {
+        // mbind() needs page-aligned memory, which new[] doesn't promise.
+        rounded = round_up(bytes, sysconf(_SC_PAGESIZE));
+        if (posix_memalign(&p, sysconf(_SC_PAGESIZE), rounded) != 0)
+            p = NULL;
+    }
+    if (p == NULL) {
+        *mode = ALLOC_HEAP;
+        return NULL;
+    }
+    if ((flags & ALLOC_NUMA_INTERLEAVE) && !numa_interleave(p, rounded)) {
+        if (!(flags & ALLOC_QUIET))
+            cerr << "Warning: couldn't interleave memory across NUMA nodes.\n";
+        flags &= ~ALLOC_NUMA_INTERLEAVE;
+    }
+    *mode = kind | flags;
+    *alloc_bytes = rounded;
+    return p;
+}
+
+/* Sums up the AnonHugePages (THP) and *_Hugetlb fields of those mappings in
+ * /proc/self/smaps that overlap [addr, addr+len). */
+static long long smaps_huge_page_bytes(const void* addr, size_t len)
+{
+    ifstream smaps("/proc/self/smaps");
+    if (!smaps) return 0;
+    unsigned long long lo = (unsigned long long) addr, hi = lo + len;
+    bool overlaps = false;
+    long long kib = 0;
+    string line;
+    while (std::getline(smaps, line)) {
+        string first_word = line.substr(0, line.find(' '));
+        if (first_word.empty()) continue;
+        if (first_word[first_word.length() - 1] != ':') {
+            // A mapping header, like "7f12a0000000-7f12e0000000 rw-p ..."
+            unsigned long long start = 0, end = 0;
+            sscanf(first_word.c_str(), "%llx-%llx", &start, &end);
+            overlaps = start < hi && end > lo;
+        } else if (overlaps && (first_word == "AnonHugePages:"
+                                || first_word == "Private_Hugetlb:"
+                                || first_word == "Shared_Hugetlb:")) {
+            kib += atoll(line.c_str() + first_word.length());
+        }
+    }
+    return kib * 1024;
+}
+
+// "123 bytes", "45 KiB", "678 MiB"
+static string human_bytes(long long n)
+{
+    if (n < 10 * 1024) return std::to_string(n) + " bytes";
+    if (n < 10 * 1024 * 1024) return std::to_string(n >> 10) + " KiB";
+    return std::to_string(n >> 20) + " MiB";
+}
+
 template <typename T>
-FileReader<T>::FileReader(string filename, bool verbose) {
+FileReader<T>::FileReader(FileSection file, bool verbose, int alloc_mode) {
+    PhaseTime start_time = phase_time_now();
+    string filename = file.file_name;
     infile = ifstream(filename, ifstream::binary);
     if (!infile) {
         std::cerr << "Error: can't open input file " << filename << std::endl;
         exit(1);
     }
 
-    // Get file size
+    // Get file size, or the section's
     file_size_bytes = file_size(&infile);
+    if (file.length >= 0) {
+        if (file.offset + file.length > (uint64_t) file_size_bytes) {
+            std::cerr << "Error: " << filename << " is too short for its sections\n";
+            exit(1);
+        }
+        file_size_bytes = file.length;
+    }
     file_size_symbols = file_size_bytes / sizeof(T);
 
     if (verbose) {
@@ -54,24 +498,122 @@ FileReader<T>::FileReader(string filename, bool verbose) {
         cerr.flush(); // reads might take a long time
     }
 
-    data_array = new T[file_size_symbols];
+    bool unpack = (alloc_mode & ALLOC_UNPACK_SA) && is_packed_sa(file);
+    alloc_mode &= ~ALLOC_UNPACK_SA;
+    if (unpack) {
+        std::vector<char> packed(file_size_bytes);
+        infile.seekg(file.offset);
+        infile.read(packed.data(), file_size_bytes);
+        infile.close();
+        PackedSAHeader header;
+        if (packed.size() < sizeof(header) || !infile) {
+            cerr << "Error: " << filename << " isn't a valid packed suffix array\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        memcpy(&header, packed.data(), sizeof(header));
+        if (header.n > 0 && header.n - 1 > std::numeric_limits<T>::max()) {
+            cerr << "Error: " << filename << " has " << header.n << " suffixes, too many for "
+                 << 8 * sizeof(T) << "-bit entries\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        file_size_symbols = header.n;
+        file_size_bytes = header.n * sizeof(T);
+        if ((alloc_mode & ALLOC_MODE_MASK) == ALLOC_MMAP) alloc_mode = ALLOC_HEAP;
+        this->alloc_mode = alloc_mode;
+        void* mem = allocate_array(file_size_bytes, &this->alloc_mode, &alloc_size);
+        data_array = mem != NULL ? static_cast<T*>(mem) : new T[file_size_symbols];
+        if (!unpack_sa(packed.data(), packed.size(), data_array)) {
+            cerr << "Error: " << filename << " isn't a valid packed suffix array\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        load_time = phase_time_since(start_time);
+        if (verbose) {
+            cerr << " unpacked " << file_size_symbols << " suffixes.\n";
+            cerr.flush();
+        }
+        return;
+    }
+
+    this->alloc_mode = alloc_mode;
+    if ((alloc_mode & ALLOC_MODE_MASK) == ALLOC_MMAP) {
+        alloc_size = file_size_bytes;
+        data_array = NULL;
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd >= 0 && file_size_bytes > 0) {
+            // mmap() wants an offset that's a multiple of the page size.
+            uint64_t lead = file.offset % sysconf(_SC_PAGESIZE);
+            alloc_size = file_size_bytes + lead;
+            void* mem = mmap(NULL, alloc_size, PROT_READ, MAP_PRIVATE, fd, file.offset - lead);
+            if (mem == MAP_FAILED) {
+                std::cerr << "Error: can't map input file " << filename << " into memory\n";
+                exit(1);
+            }
+            // The parser's searches jump around; readahead would be wasted.
+            madvise(mem, alloc_size, MADV_RANDOM);
+            data_array = reinterpret_cast<T*>(static_cast<char*>(mem) + lead);
+        }
+        if (fd >= 0) close(fd);
+        infile.close();
+        load_time = phase_time_since(start_time);
+        if (verbose) {
+            cerr << " mapped " << file_size_symbols << " symbols.\n";
+            cerr.flush();
+        }
+        return;
+    }
+    void* mem = allocate_array(file_size_symbols * sizeof(T),
+                               &this->alloc_mode, &alloc_size);
+    if (mem != NULL) {
+        data_array = static_cast<T*>(mem);
+    } else {
+        data_array = new T[file_size_symbols];
+    }
+    infile.seekg(file.offset);
     infile.read(reinterpret_cast<char *>(data_array), file_size_bytes);
     infile.close();
+    load_time = phase_time_since(start_time);
     if (verbose) {
         cerr << " read " << file_size_symbols << " symbols.\n";
         cerr.flush();
     }
 }
 
+void symbol_view_out_of_bounds(long long i, long long size) {
+    cerr << "bug: symbol index " << i << " out of bounds, size " << size << "\n";
+    abort();
+}
+
 template <typename T>
-long long FileReader<T>::size() { return file_size_symbols; }
+long long FileReader<T>::huge_page_bytes() {
+    return smaps_huge_page_bytes(data_array, alloc_size);
+}
 
 template <typename T>
-T FileReader<T>::operator[](long long i) { return data_array[i]; }
+std::string FileReader<T>::memory_report() {
+    long long huge = huge_page_bytes();
+    string report = human_bytes(file_size_symbols * sizeof(T));
+    int kind = alloc_mode & ALLOC_MODE_MASK;
+    if (kind == ALLOC_MMAP) return report + ", mapped from disk";
+    if (kind != ALLOC_HEAP || huge > 0) {
+        report += ", " + human_bytes(huge) + " in huge pages";
+        if (kind == ALLOC_HUGETLB) report += " (hugetlbfs)";
+        else if (kind == ALLOC_HUGEPAGE) report += " (THP)";
+    }
+    if (alloc_mode & ALLOC_NUMA_INTERLEAVE) {
+        string placement = numa_placement(data_array, alloc_size);
+        report += ", interleaved";
+        if (placement.length() > 0) report += " (" + placement + ")";
+    }
+    return report;
+}
 
 template <typename T>
 std::string FileReader<T>::as_string(long long i) {
-    T sym = data_array[i];
+    return symbol_as_string(data_array[i]);
+}
+
+template <typename T>
+std::string symbol_as_string(T sym) {
     ostringstream os;
     if (sizeof(T) == 1) {
         if (sym >= ' ' && sym <= '~') {
@@ -127,6 +669,14 @@ std::string FileReader<T>::as_string(long long i) {
     return os.str();
 }
 
+template std::string symbol_as_string<uint8_t>(uint8_t);
+template std::string symbol_as_string<uint16_t>(uint16_t);
+template std::string symbol_as_string<uint32_t>(uint32_t);
+template std::string symbol_as_string<uint64_t>(uint64_t);
+template std::string symbol_as_string<packed24>(packed24);
+template std::string symbol_as_string<packed40>(packed40);
+template std::string symbol_as_string<packed48>(packed48);
+
 
 /***** RLZInputReader *****/
 
@@ -223,6 +773,41 @@ RLZToken RLZInputReader::next_token_vbyte() {
     return token;
 }
 
+// Same coding as in next_token_vbyte(), one number at a time.
+bool RLZInputReader::next_number_vbyte(uint64_t* n) {
+    *n = 0;
+    for (int shiftwidth = 0; ; shiftwidth += 7) {
+        int c = infile.get();
+        if (infile.fail()) return false;
+        if (shiftwidth > 63) {
+            cerr << "error: vbyte decoder read a sequence that doesn't fit into 64 bits.\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        uint64_t c64 = (uint64_t) c;
+        *n |= (c64 & 0x7F) << shiftwidth;
+        if (!(c64 & 0x80)) return true;
+    }
+}
+
+// See FMT_DELTA in rlzcommon.h.
+RLZToken RLZInputReader::next_token_delta() {
+    uint64_t head, second;
+    if (!next_number_vbyte(&head)) return end_sentinel;
+    RLZToken token;
+    token.length = head >> 1;
+    if (head & 1) {
+        token.start_pos = delta_prev_end;
+    } else {
+        if (!next_number_vbyte(&second)) return end_sentinel;
+        token.start_pos = token.length == 0
+                          ? second
+                          : delta_prev_end + zigzag_decode(second);
+    }
+    if (token.length > 0)
+        delta_prev_end = token.start_pos + token.length;
+    return token;
+}
+
 // public:
 RLZInputReader::RLZInputReader(std::string filename, int input_mode) {
     infile = std::ifstream(filename, std::ifstream::binary);
@@ -231,6 +816,34 @@ RLZInputReader::RLZInputReader(std::string filename, int input_mode) {
         exit(1);
     }
     mode = input_mode;
+    literal_width = 0;
+    delta_prev_end = 0;
+}
+
+void RLZInputReader::read_literals(void* dest, uint64_t count) {
+    if (mode != FMT_ASCII) {
+        infile.read(static_cast<char*>(dest), count * literal_width);
+    } else {
+        for (uint64_t i = 0; i < count && infile; i++) {
+            std::string sym_s;
+            infile >> sym_s;
+            if (!infile) break;
+            uint64_t sym = std::stoull(sym_s, nullptr, 0);
+            switch (literal_width) {
+                case 1: static_cast<uint8_t*>(dest)[i] = (uint8_t) sym; break;
+                case 2: static_cast<uint16_t*>(dest)[i] = (uint16_t) sym; break;
+                case 4: static_cast<uint32_t*>(dest)[i] = (uint32_t) sym; break;
+                case 8: static_cast<uint64_t*>(dest)[i] = sym; break;
+                default: // packed, see PackedSymbol
+                    memcpy(static_cast<char*>(dest) + i * literal_width, &sym, literal_width);
+                    break;
+            }
+        }
+    }
+    if (!infile) {
+        cerr << "Error: input ends in the middle of a run of " << count << " literals\n";
+        exit(EXIT_INVALID_INPUT);
+    }
 }
 
 RLZToken RLZInputReader::next_token() {
@@ -254,6 +867,7 @@ RLZToken RLZInputReader::next_token() {
             return tok;
             break;
         }
+        case FMT_DELTA: return this->next_token_delta();
         default:
             cerr << "bug in next_token(), mode code 0x" << std::hex << mode << "\n";
             exit(EXIT_BUG);
@@ -264,5 +878,713 @@ bool RLZInputReader::keep_going() {
     return !(infile.eof() || infile.fail());
 }
 
+uint64_t RLZInputReader::position() {
+    return (uint64_t) infile.tellg();
+}
+
+void RLZInputReader::seek(uint64_t offset, uint64_t delta_state) {
+    infile.clear();
+    infile.seekg(offset);
+    delta_prev_end = delta_state;
+}
+
+
+
 
 
+/***** .rlzdict bundles *****/
+
+bool read_dict_bundle(std::string filename, DictBundleHeader* header) {
+    ifstream in(filename, ifstream::binary);
+    if (!in) {
+        cerr << "Error: can't open input file " << filename << std::endl;
+        exit(EXIT_INVALID_INPUT);
+    }
+    uint64_t size = file_size(&in);
+    memset(header, 0, sizeof(*header));
+    in.read(reinterpret_cast<char*>(header), sizeof(*header));
+    if (in.gcount() < (std::streamsize) sizeof(header->magic)
+            || memcmp(header->magic, RLZDICT_MAGIC, sizeof(header->magic)) != 0)
+        return false;
+    string problem = "";
+    if (in.gcount() < (std::streamsize) sizeof(*header)) {
+        problem = "its header is cut short";
+    } else if (header->version != RLZDICT_VERSION) {
+        problem = "it's version " + std::to_string(header->version)
+                  + ", not " + std::to_string(RLZDICT_VERSION);
+    } else if (header->n_sections > RLZDICT_MAX_SECTIONS) {
+        problem = "it has too many sections";
+    } else if (!is_symbol_width(header->symbol_width)) {
+        problem = "its symbol width isn't 8, 16, 24, 32, 40, 48 or 64";
+    } else if (header->sa_width != 32 && header->sa_width != 64) {
+        problem = "its suffix array width isn't 32 or 64";
+    } else if (dict_bundle_section(header, RLZDICT_DICT) == NULL
+               || dict_bundle_section(header, RLZDICT_SA) == NULL) {
+        problem = "it has no dictionary or suffix array";
+    }
+    for (uint32_t i = 0; i < header->n_sections && problem.length() == 0; i++) {
+        const DictBundleSection* s = &header->sections[i];
+        if (s->offset % RLZDICT_ALIGN != 0 || s->offset > size || s->length > size - s->offset)
+            problem = "section " + std::to_string(i) + " isn't within the file";
+    }
+    if (problem.length() > 0) {
+        cerr << "Error: " << filename << " is an .rlzdict bundle, but " << problem << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    return true;
+}
+
+const DictBundleSection* dict_bundle_section(const DictBundleHeader* header,
+                                             uint32_t type) {
+    for (uint32_t i = 0; i < header->n_sections && i < RLZDICT_MAX_SECTIONS; i++) {
+        if (header->sections[i].type == type)
+            return &header->sections[i];
+    }
+    return NULL;
+}
+
+FileSection bundle_section(const DictBundleHeader* header,
+                           std::string file_name, uint32_t type) {
+    if (header == NULL) return FileSection(file_name);
+    const DictBundleSection* s = dict_bundle_section(header, type);
+    if (s == NULL) {
+        cerr << "Bug: no section " << type << " in " << file_name << "\n";
+        exit(EXIT_BUG);
+    }
+    return FileSection(file_name, s->offset, s->length);
+}
+
+
+/***** MappedFile *****/
+
+MappedFile::MappedFile(std::string filename) {
+    data_ptr = NULL;
+    size_bytes = 0;
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        cerr << "Error: can't open input file " << filename << std::endl;
+        exit(EXIT_INVALID_INPUT);
+    }
+    size_bytes = st.st_size;
+    if (size_bytes > 0) {
+        void* mem = mmap(NULL, size_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mem == MAP_FAILED) {
+            cerr << "Error: can't map input file " << filename << " into memory\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        madvise(mem, size_bytes, MADV_SEQUENTIAL);
+        data_ptr = static_cast<const uint8_t*>(mem);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ptr != NULL)
+        munmap(const_cast<uint8_t*>(data_ptr), size_bytes);
+}
+
+
+/***** RLZBufferReader *****/
+
+RLZBufferReader::RLZBufferReader(const uint8_t* begin, const uint8_t* end,
+                                 int input_mode)
+    : p(begin), end(end), mode(input_mode), delta_prev_end(0), literal_width(0) {}
+
+// Unsigned decimal, or hex with a 0x prefix, like stoul(..., 0) reads them.
+bool RLZBufferReader::next_number_ascii(uint64_t* n) {
+    while (p < end && isspace(*p)) p++;
+    if (p == end) return false;
+    int base = 10;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+    *n = 0;
+    const uint8_t* start = p;
+    for (; p < end && isxdigit(*p); p++) {
+        int digit = isdigit(*p) ? *p - '0' : tolower(*p) - 'a' + 10;
+        if (digit >= base) break;
+        *n = *n * base + digit;
+    }
+    return p > start;
+}
+
+// Same coding as in next_token_vbyte().
+bool RLZBufferReader::next_number_vbyte(uint64_t* n) {
+    *n = 0;
+    for (int shiftwidth = 0; p < end; shiftwidth += 7) {
+        if (shiftwidth > 63) {
+            cerr << "error: vbyte decoder read a sequence that doesn't fit into 64 bits.\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        uint64_t c64 = *p++;
+        *n |= (c64 & 0x7F) << shiftwidth;
+        if (!(c64 & 0x80)) return true;
+    }
+    return false;
+}
+
+size_t RLZBufferReader::next(RLZToken* token) {
+    const uint8_t* start = p;
+    switch (mode) {
+        case FMT_32X2: {
+            uint32_t buf[2];
+            if (end - p < (long) sizeof(buf)) return 0;
+            memcpy(buf, p, sizeof(buf));
+            p += sizeof(buf);
+            token->start_pos = buf[0];
+            token->length = buf[1];
+            break;
+        }
+        case FMT_64X2: {
+            uint64_t buf[2];
+            if (end - p < (long) sizeof(buf)) return 0;
+            memcpy(buf, p, sizeof(buf));
+            p += sizeof(buf);
+            token->start_pos = buf[0];
+            token->length = buf[1];
+            break;
+        }
+        case FMT_VBYTE:
+        case FMT_ASCII: {
+            uint64_t pos, len;
+            bool ok = mode == FMT_VBYTE
+                      ? next_number_vbyte(&pos) && next_number_vbyte(&len)
+                      : next_number_ascii(&pos) && next_number_ascii(&len);
+            if (!ok) return 0;
+            token->start_pos = pos;
+            token->length = len;
+            break;
+        }
+        case FMT_DELTA: {
+            uint64_t head, second = 0;
+            if (!next_number_vbyte(&head)) return 0;
+            if (!(head & 1) && !next_number_vbyte(&second)) return 0;
+            token->length = head >> 1;
+            if (head & 1)
+                token->start_pos = delta_prev_end;
+            else if (token->length == 0)
+                token->start_pos = second;
+            else
+                token->start_pos = delta_prev_end + zigzag_decode(second);
+            if (token->length > 0)
+                delta_prev_end = token->start_pos + token->length;
+            break;
+        }
+        default:
+            cerr << "bug in RLZBufferReader::next(), mode code 0x" << std::hex << mode << "\n";
+            exit(EXIT_BUG);
+    }
+    if (literal_width > 0 && token->length == 0) {
+        if (mode == FMT_ASCII) {
+            uint64_t sym;
+            for (uint64_t i = 0; i < token->start_pos; i++)
+                if (!next_number_ascii(&sym)) return 0;
+        } else {
+            if (token->start_pos > (uint64_t) (end - p) / literal_width) return 0;
+            p += token->start_pos * literal_width;
+        }
+    }
+    return p - start;
+}
+
+
+/***** CoverageBitmap *****/
+
+CoverageBitmap::CoverageBitmap(uint64_t n) {
+    n_bits = n;
+    words = new std::atomic<uint64_t>[n / 64 + 1];
+    for (uint64_t i = 0; i <= n / 64; i++)
+        words[i].store(0, std::memory_order_relaxed);
+}
+
+CoverageBitmap::~CoverageBitmap() {
+    delete[] words;
+}
+
+void CoverageBitmap::mark(uint64_t from, uint64_t to) {
+    while (from < to) {
+        uint64_t bit = from % 64;
+        uint64_t n = to - from < 64 - bit ? to - from : 64 - bit;
+        uint64_t mask = n == 64 ? ~0ULL : ((1ULL << n) - 1) << bit;
+        std::atomic<uint64_t>* word = &words[from / 64];
+        // Most phrases land on ground that's been covered already, and a
+        // load is much cheaper than a contended read-modify-write.
+        if ((word->load(std::memory_order_relaxed) & mask) != mask)
+            word->fetch_or(mask, std::memory_order_relaxed);
+        from += n;
+    }
+}
+
+bool CoverageBitmap::mark_one(uint64_t i) {
+    uint64_t mask = 1ULL << (i % 64);
+    return !(words[i / 64].fetch_or(mask, std::memory_order_relaxed) & mask);
+}
+
+uint64_t CoverageBitmap::count(uint64_t from, uint64_t to) {
+    uint64_t total = 0;
+    while (from < to) {
+        uint64_t bit = from % 64;
+        uint64_t n = to - from < 64 - bit ? to - from : 64 - bit;
+        uint64_t mask = n == 64 ? ~0ULL : ((1ULL << n) - 1) << bit;
+        total += __builtin_popcountll(words[from / 64].load(std::memory_order_relaxed) & mask);
+        from += n;
+    }
+    return total;
+}
+
+bool CoverageBitmap::write(std::ostream& out) {
+    for (uint64_t i = 0; i < (n_bits + 63) / 64; i++) {
+        uint64_t w = words[i].load(std::memory_order_relaxed);
+        out.write(reinterpret_cast<const char*>(&w), sizeof(w));
+    }
+    return !out.fail();
+}
+
+
+/***** PhraseIndex *****/
+
+// The position of the r'th (from 0) set bit of w; w has more than r.
+static int select_in_word(uint64_t w, uint64_t r) {
+    for (; r > 0; r--)
+        w &= w - 1;
+    return __builtin_ctzll(w);
+}
+
+static void read_or_die(std::ifstream& in, void* dest, uint64_t bytes,
+                        std::string filename) {
+    in.read(static_cast<char*>(dest), bytes);
+    if (!in) {
+        cerr << "Error: phrase index " << filename << " is truncated\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+}
+
+PhraseIndex::PhraseIndex(std::string filename) {
+    std::ifstream in(filename, std::ifstream::binary);
+    if (!in) {
+        cerr << "Error: can't open phrase index " << filename << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    uint64_t header[8];
+    read_or_die(in, header, sizeof(header), filename);
+    if (header[0] != PHRASE_INDEX_MAGIC || header[4] > 63) {
+        cerr << "Error: " << filename << " isn't a phrase index\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    mode = header[1];
+    n_tokens = header[2];
+    n_symbols = header[3];
+    low_bits = header[4];
+    interval = header[5];
+    uint64_t n_samples = header[6];
+    high_bits = n_tokens + (n_symbols >> low_bits) + 1;
+
+    low.resize((n_tokens * low_bits + 63) / 64);
+    high.resize((high_bits + 63) / 64);
+    offsets.resize(n_samples);
+    delta_states.resize(n_samples);
+    read_or_die(in, low.data(), low.size() * 8, filename);
+    read_or_die(in, high.data(), high.size() * 8, filename);
+    read_or_die(in, offsets.data(), n_samples * 8, filename);
+    read_or_die(in, delta_states.data(), n_samples * 8, filename);
+
+    // Select samples: where the 0th, 512th, 1024th... one and zero are.
+    uint64_t ones_seen = 0, zeros_seen = 0;
+    for (uint64_t i = 0; i < high.size(); i++) {
+        uint64_t bits_here = i + 1 < high.size() ? 64 : high_bits - i * 64;
+        uint64_t w = high[i];
+        uint64_t w0 = ~w & (bits_here == 64 ? ~0ULL : (1ULL << bits_here) - 1);
+        uint64_t c1 = __builtin_popcountll(w), c0 = __builtin_popcountll(w0);
+        while (ones.size() * PHRASE_INDEX_SELECT_SAMPLE < ones_seen + c1)
+            ones.push_back(i * 64 + select_in_word(w, ones.size() * PHRASE_INDEX_SELECT_SAMPLE - ones_seen));
+        while (zeros.size() * PHRASE_INDEX_SELECT_SAMPLE < zeros_seen + c0)
+            zeros.push_back(i * 64 + select_in_word(w0, zeros.size() * PHRASE_INDEX_SELECT_SAMPLE - zeros_seen));
+        ones_seen += c1;
+        zeros_seen += c0;
+    }
+    if (ones_seen != n_tokens) {
+        cerr << "Error: phrase index " << filename << " is corrupt\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+}
+
+uint64_t PhraseIndex::get_low(uint64_t i) {
+    if (low_bits == 0) return 0;
+    uint64_t bit = i * low_bits;
+    uint64_t word = bit / 64, shift = bit % 64;
+    uint64_t v = low[word] >> shift;
+    if (shift + low_bits > 64)
+        v |= low[word + 1] << (64 - shift);
+    return v & ((1ULL << low_bits) - 1);
+}
+
+uint64_t PhraseIndex::select(bool one, uint64_t k) {
+    std::vector<uint64_t>& samples = one ? ones : zeros;
+    uint64_t pos = samples[k / PHRASE_INDEX_SELECT_SAMPLE];
+    uint64_t r = k % PHRASE_INDEX_SELECT_SAMPLE;
+    uint64_t word = pos / 64;
+    uint64_t w = (one ? high[word] : ~high[word]) & (~0ULL << (pos % 64));
+    for (;;) {
+        uint64_t c = __builtin_popcountll(w);
+        if (r < c)
+            return word * 64 + select_in_word(w, r);
+        r -= c;
+        word++;
+        w = one ? high[word] : ~high[word];
+    }
+}
+
+uint64_t PhraseIndex::phrase_end(uint64_t i) {
+    return (select(true, i) - i) << low_bits | get_low(i);
+}
+
+uint64_t PhraseIndex::token_at(uint64_t pos) {
+    if (pos >= n_symbols) return n_tokens;
+    // The ends are exclusive, so this is the number of ends <= pos.
+    uint64_t h = pos >> low_bits;
+    uint64_t p = h == 0 ? 0 : select(false, h - 1) + 1;
+    uint64_t i = p - h; // ends with smaller high bits
+    uint64_t low_pos = pos & ((1ULL << low_bits) - 1);
+    while (p < high_bits && (high[p / 64] >> (p % 64) & 1) && get_low(i) <= low_pos) {
+        i++;
+        p++;
+    }
+    return i;
+}
+
+uint64_t PhraseIndex::size_bytes() {
+    return 64 + (low.size() + high.size() + 2 * offsets.size()) * 8;
+}
+
+void write_phrase_index(std::string rlz_file_name, int mode,
+                        int literal_width, std::string index_file_name) {
+    std::vector<uint64_t> scratch;
+    // A token's length in symbols, reading past a literal run's symbols.
+    auto token_symbols = [&](RLZInputReader* reader, RLZToken* tok) -> uint64_t {
+        if (tok->length > 0) return tok->length;
+        if (literal_width == 0) return 1;
+        if (tok->start_pos == 0 || tok->start_pos > LITERAL_RUN_MAX) {
+            cerr << "Error: literal run of " << tok->start_pos << " symbols in "
+                 << rlz_file_name << "\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        scratch.resize(tok->start_pos);
+        reader->read_literals(scratch.data(), tok->start_pos);
+        return tok->start_pos;
+    };
+
+    uint64_t n = 0, u = 0;
+    {
+        RLZInputReader reader(rlz_file_name, mode);
+        reader.literal_width = literal_width;
+        while (reader.keep_going()) {
+            RLZToken tok = reader.next_token();
+            if (is_end_sentinel(&tok)) break;
+            u += token_symbols(&reader, &tok);
+            n++;
+        }
+    }
+
+    int low_bits = 0;
+    while (n > 0 && (u >> (low_bits + 1)) >= n)
+        low_bits++;
+    uint64_t high_bits = n + (u >> low_bits) + 1;
+    // Literal runs make 32x2 and 64x2 tokens variable-width too.
+    bool fixed_width = (mode == FMT_32X2 || mode == FMT_64X2) && literal_width == 0;
+    uint64_t interval = fixed_width ? 0 : PHRASE_INDEX_INTERVAL;
+    std::vector<uint64_t> low((n * low_bits + 63) / 64, 0);
+    std::vector<uint64_t> high((high_bits + 63) / 64, 0);
+    std::vector<uint64_t> offsets, delta_states;
+
+    RLZInputReader reader(rlz_file_name, mode);
+    reader.literal_width = literal_width;
+    uint64_t end = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (interval > 0 && i % interval == 0) {
+            offsets.push_back(reader.position());
+            delta_states.push_back(reader.delta_state());
+        }
+        RLZToken tok = reader.next_token();
+        if (is_end_sentinel(&tok)) {
+            cerr << "Error: " << rlz_file_name << " changed while being indexed\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        end += token_symbols(&reader, &tok);
+        if (low_bits > 0) {
+            uint64_t v = end & ((1ULL << low_bits) - 1);
+            uint64_t bit = i * low_bits;
+            low[bit / 64] |= v << (bit % 64);
+            if (bit % 64 + low_bits > 64)
+                low[bit / 64 + 1] |= v >> (64 - bit % 64);
+        }
+        uint64_t hb = (end >> low_bits) + i;
+        high[hb / 64] |= 1ULL << (hb % 64);
+    }
+
+    std::ofstream out(index_file_name, std::ofstream::binary | std::ofstream::trunc);
+    uint64_t header[8] = { PHRASE_INDEX_MAGIC, (uint64_t) mode, n, u,
+                           (uint64_t) low_bits, interval, offsets.size(), 0 };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(low.data()), low.size() * 8);
+    out.write(reinterpret_cast<const char*>(high.data()), high.size() * 8);
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * 8);
+    out.write(reinterpret_cast<const char*>(delta_states.data()), delta_states.size() * 8);
+    if (!out) {
+        cerr << "Error: can't write phrase index " << index_file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+}
+
+
+/***** check_suffix_array *****/
+
+/* Whether the suffix starting at a is less than the one starting at b.
+ * Equal runs are skipped a block at a time with memcmp(), which libc
+ * vectorises; only the block with the first difference is compared symbol
+ * by symbol, since for T wider than a byte memcmp() can't tell which of two
+ * little-endian numbers is the smaller. */
+#define SUFFIX_COMPARE_BLOCK 64
+
+template <typename T>
+static bool suffix_less(const T* dict, uint64_t n, uint64_t a, uint64_t b)
+{
+    if (a == b) return false;
+    uint64_t len = n - (a > b ? a : b); // symbols both suffixes have
+    uint64_t i = 0;
+    while (len - i >= SUFFIX_COMPARE_BLOCK
+           && memcmp(dict + a + i, dict + b + i, SUFFIX_COMPARE_BLOCK * sizeof(T)) == 0)
+        i += SUFFIX_COMPARE_BLOCK;
+    for (; i < len; i++) {
+        if (dict[a + i] != dict[b + i])
+            return dict[a + i] < dict[b + i];
+    }
+    return a > b; // the shorter one, a prefix of the other, comes first
+}
+
+template <typename T, typename S>
+SACheckResult check_suffix_array(SymbolView<T> dict, SymbolView<S> sa,
+                                 unsigned int threads)
+{
+    uint64_t n = dict.size();
+    uint64_t sa_n = sa.size();
+    const T* d = dict.data();
+    const S* s = sa.data();
+    if (threads == 0) threads = 1;
+
+    SACheckResult total = { sa_n != n, 0, 0, 0, -1, -1 };
+    std::vector<SACheckResult> results(threads, total);
+    CoverageBitmap seen(n);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            SACheckResult* r = &results[t];
+            uint64_t begin = sa_n * t / threads, end = sa_n * (t + 1) / threads;
+            for (uint64_t i = begin; i < end; i++) {
+                uint64_t x = s[i];
+                if (x >= n) {
+                    r->out_of_range++;
+                } else if (!seen.mark_one(x)) {
+                    r->duplicates++;
+                } else {
+                    continue;
+                }
+                if (r->first_invalid < 0) r->first_invalid = i;
+            }
+            // Each thread also checks the pair that straddles its end.
+            for (uint64_t i = begin; i < end && i + 1 < sa_n; i++) {
+                if (s[i] >= n || s[i + 1] >= n) continue; // already counted
+                if (!suffix_less(d, n, s[i], s[i + 1])) {
+                    r->misordered++;
+                    if (r->first_misordered < 0) r->first_misordered = i;
+                }
+            }
+        }));
+    }
+    for (std::thread& w : workers) w.join();
+
+    for (SACheckResult& r : results) {
+        total.out_of_range += r.out_of_range;
+        total.duplicates += r.duplicates;
+        total.misordered += r.misordered;
+        if (total.first_invalid < 0) total.first_invalid = r.first_invalid;
+        if (total.first_misordered < 0) total.first_misordered = r.first_misordered;
+    }
+    return total;
+}
+
+#define INSTANTIATE_CHECK_SUFFIX_ARRAY(T) \
+    template SACheckResult check_suffix_array<T, uint32_t>(SymbolView<T>, SymbolView<uint32_t>, unsigned int); \
+    template SACheckResult check_suffix_array<T, uint64_t>(SymbolView<T>, SymbolView<uint64_t>, unsigned int);
+INSTANTIATE_CHECK_SUFFIX_ARRAY(uint8_t)
+INSTANTIATE_CHECK_SUFFIX_ARRAY(uint16_t)
+INSTANTIATE_CHECK_SUFFIX_ARRAY(uint32_t)
+INSTANTIATE_CHECK_SUFFIX_ARRAY(uint64_t)
+INSTANTIATE_CHECK_SUFFIX_ARRAY(packed24)
+INSTANTIATE_CHECK_SUFFIX_ARRAY(packed40)
+INSTANTIATE_CHECK_SUFFIX_ARRAY(packed48)
+
+void print_sa_check_errors(SACheckResult* result)
+{
+    if (result->size_mismatch)
+        cerr << "Error: suffix array and dictionary are of different lengths;"
+                " check --width and --sa-width\n";
+    if (result->out_of_range > 0)
+        cerr << "Error: " << result->out_of_range << " suffix array entries point"
+                " past the end of the dictionary\n";
+    if (result->duplicates > 0)
+        cerr << "Error: " << result->duplicates << " suffix array entries are"
+                " repeats of others\n";
+    if (result->first_invalid >= 0)
+        cerr << "Error: one bad entry is at index " << result->first_invalid << "\n";
+    if (result->misordered > 0)
+        cerr << "Error: " << result->misordered << " suffixes are out of order,"
+                " the first at index " << result->first_misordered << "\n";
+}
+
+
+/***** PerfCounters *****/
+
+#ifdef __linux__
+static int open_perf_event(int event)
+{
+    struct perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.type = PERF_TYPE_HARDWARE;
+    switch (event) {
+        case PERF_CYCLES: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case PERF_INSTRUCTIONS: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case PERF_LLC_MISSES: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        case PERF_BRANCH_MISSES: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+        case PERF_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default: return -1;
+    }
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+    for (int e = 0; e < PERF_N_EVENTS; e++) {
+#ifdef __linux__
+        fds[e] = open_perf_event(e);
+#else
+        fds[e] = -1;
+#endif
+        counts[e] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int e = 0; e < PERF_N_EVENTS; e++)
+        if (fds[e] >= 0) close(fds[e]);
+}
+
+bool PerfCounters::available() {
+    for (int e = 0; e < PERF_N_EVENTS; e++)
+        if (fds[e] >= 0) return true;
+    return false;
+}
+
+void PerfCounters::start() {
+#ifdef __linux__
+    for (int e = 0; e < PERF_N_EVENTS; e++) {
+        if (fds[e] < 0) continue;
+        ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+void PerfCounters::pause() {
+#ifdef __linux__
+    for (int e = 0; e < PERF_N_EVENTS; e++)
+        if (fds[e] >= 0) ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+}
+
+void PerfCounters::resume() {
+#ifdef __linux__
+    for (int e = 0; e < PERF_N_EVENTS; e++)
+        if (fds[e] >= 0) ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+void PerfCounters::stop() {
+    for (int e = 0; e < PERF_N_EVENTS; e++) {
+        counts[e] = -1;
+#ifdef __linux__
+        if (fds[e] < 0) continue;
+        ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        // value, time enabled, time running
+        uint64_t buf[3];
+        if (read(fds[e], buf, sizeof(buf)) != (ssize_t) sizeof(buf))
+            continue;
+        if (buf[2] == 0) {
+            counts[e] = buf[0] == 0 ? 0 : -1;
+        } else if (buf[2] < buf[1]) {
+            counts[e] = (long long) (buf[0] * ((double) buf[1] / buf[2]));
+        } else {
+            counts[e] = (long long) buf[0];
+        }
+#endif
+    }
+}
+
+long long PerfCounters::get(int event) {
+    if (event < 0 || event >= PERF_N_EVENTS) return -1;
+    return counts[event];
+}
+
+const char* PerfCounters::name(int event) {
+    switch (event) {
+        case PERF_CYCLES: return "cycles";
+        case PERF_INSTRUCTIONS: return "instructions";
+        case PERF_LLC_MISSES: return "llc_misses";
+        case PERF_DTLB_MISSES: return "dtlb_misses";
+        case PERF_BRANCH_MISSES: return "branch_misses";
+        default: return "unknown";
+    }
+}
+
+std::string PerfCounters::report(uint64_t symbols) {
+    if (!available())
+        return "hardware counters: not available\n";
+    ostringstream os;
+    os << std::fixed << std::setprecision(2);
+    double per_symbol = symbols > 0 ? symbols : 1;
+    for (int e = 0; e < PERF_N_EVENTS; e++) {
+        os << name(e) << " ";
+        if (counts[e] < 0) {
+            os << "n/a\n";
+            continue;
+        }
+        os << counts[e];
+        if (e == PERF_INSTRUCTIONS && counts[PERF_CYCLES] > 0)
+            os << " (" << counts[e] / (double) counts[PERF_CYCLES] << " per cycle)";
+        else if (e != PERF_INSTRUCTIONS)
+            os << " (" << counts[e] / per_symbol << " per symbol)";
+        os << "\n";
+    }
+    return os.str();
+}
+
+std::string PerfCounters::json() {
+    string s = "{";
+    for (int e = 0; e < PERF_N_EVENTS; e++) {
+        if (e > 0) s += ", ";
+        s += string("\"") + name(e) + "\": ";
+        s += counts[e] < 0 ? string("null") : std::to_string(counts[e]);
+    }
+    return s + "}";
+}
@@ -12,9 +12,15 @@
 #ifndef RLZ_COMMON_H_INCLUDED
 #define RLZ_COMMON_H_INCLUDED
 
+#include <atomic>
 #include <climits>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
 
 /* Common data type for representing RLZ tokens across rlzparse & friends.
  * RLZ parsing output will be a stream of these in some binary output format.
@@ -48,6 +54,32 @@ bool is_end_sentinel(RLZToken* token);
 #define FMT_64X2  (0x32783436)  /* '64x2' */
 #define FMT_ASCII (0x74786574)  /* 'text' */
 #define FMT_VBYTE (0x74796276)  /* 'vbyt' */
+#define FMT_DELTA (0x746c6564)  /* 'delt' */
+
+/* -f delta is vbyte numbers, but each token starts with one number h, which
+ * holds the length and a flag: the length is h >> 1, and if h is odd, the
+ * phrase starts right where the previous phrase ended in the dictionary,
+ * so that's the whole token (one byte for lengths under 64). If h is even
+ * a second number follows: for a phrase, its distance from the previous
+ * phrase's end, zig-zag coded so that small negative distances stay small
+ * too, and for a literal (length 0), the symbol itself. The "previous
+ * phrase's end" is 0 before the first phrase, and literals don't move it. */
+inline uint64_t zigzag_encode(int64_t x)
+{
+    return ((uint64_t) x << 1) ^ (uint64_t) (x >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t x)
+{
+    return (int64_t) (x >> 1) ^ -(int64_t) (x & 1);
+}
+
+/* With --literal-runs (in any of the formats above), a token of length zero
+ * isn't a literal, but a header for a run of literals: its start_pos is the
+ * number of literal symbols k, and the k symbols follow the token as they
+ * are, in machine byte order -- or in -f ascii as one decimal number per
+ * line. Runs are at most this long. */
+#define LITERAL_RUN_MAX 65536
 
 // Common definitions for exit codes: was the problem caused by us or not?
 #define EXIT_BUG 33          /* '!' */
@@ -57,32 +89,462 @@ bool is_end_sentinel(RLZToken* token);
 // Seeks (ifstream.seekg()) to the end of a file to find out how big it is.
 long file_size(std::ifstream* ifs);
 
+/* Phrase length histograms, as printed by rlzparse --stats and
+ * rlzexplain --analyze: bucket 0 is literals, bucket k > 0 is lengths
+ * from 2^(k-1) to 2^k - 1. */
+#define LENGTH_HISTOGRAM_BUCKETS 65
+int length_histogram_bucket(int64_t length);
+
+/* Wall-clock and CPU (user + system, whole process) time in seconds,
+ * for timing the phases of a run. phase_time_now() is a point in time,
+ * phase_time_since() the time elapsed after one. */
+struct PhaseTime {
+    double wall;
+    double cpu;
+};
+PhaseTime phase_time_now();
+PhaseTime phase_time_since(PhaseTime start);
+
+// The process's current resident set size from /proc/self/statm, or -1.
+long long current_rss_bytes();
+
+/* How FileReader allocates the memory it reads its file into.
+ * The binary searches in rlzparse jump all over the dictionary and the
+ * suffix array, so with multi-gigabyte files nearly every access is a TLB
+ * miss with ordinary 4 KiB pages; backing the arrays with 2 MiB pages
+ * makes the page tables small enough to mostly stay cached.
+ * ALLOC_HUGEPAGE asks for transparent huge pages with madvise(), which the
+ * kernel may or may not honour; ALLOC_HUGETLB takes pages from the
+ * preallocated hugetlbfs pool (see /proc/sys/vm/nr_hugepages), and falls
+ * back to ALLOC_HUGEPAGE if the pool is too small.
+ * ALLOC_NUMA_INTERLEAVE can be OR'd onto any of these: it spreads the pages
+ * round-robin over all NUMA nodes, so that on a multi-socket machine every
+ * core sees the same average latency instead of half of them going remote.
+ * ALLOC_MMAP doesn't read the file at all, but maps it read-only, for files
+ * bigger than memory; pages come in from disk as they're touched. It can't
+ * be combined with the others.
+ * ALLOC_UNPACK_SA is for suffix arrays: if the file is a packed suffix array
+ * (see below), it's unpacked into the array instead of being read as it is.
+ * It can be OR'd onto any mode; with ALLOC_MMAP, a packed file is unpacked
+ * onto the heap, as there's nothing in it to map.
+ * ALLOC_QUIET, for -q, leaves out the warnings about falling back from huge
+ * pages or NUMA interleaving when the system doesn't give us them. */
+#define ALLOC_HEAP     0
+#define ALLOC_HUGEPAGE 1
+#define ALLOC_HUGETLB  2
+#define ALLOC_MMAP     3
+#define ALLOC_MODE_MASK 0x0F
+#define ALLOC_NUMA_INTERLEAVE 0x10
+#define ALLOC_UNPACK_SA 0x20
+#define ALLOC_QUIET 0x40
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* A symbol N bytes wide, for the widths that fall between the integer
+ * types: -w 24, 40 and 48. The bytes are kept as they are in the file,
+ * little-endian and unpadded, so a file of them is read in as it is and a
+ * 24-bit dictionary takes 3/4 of the memory of one padded to 32 bits.
+ * It converts to and from uint64_t, and so compares like the number it
+ * holds: the templates that take uint32_t symbols take these the same way,
+ * and since N is a constant, each access compiles to a couple of loads. */
+template <int N> struct PackedSymbol {
+    uint8_t bytes[N];
+
+    PackedSymbol() = default;
+
+    /* Stored and loaded in 4-, 2- and 1-byte pieces: memcpy() of N bytes
+     * to or from a uint64_t goes through the stack, and every access
+     * stalls on store forwarding. */
+    PackedSymbol(uint64_t x)
+    {
+        int i = 0;
+        if (N - i >= 4) {
+            uint32_t w = x >> (8 * i);
+            memcpy(bytes + i, &w, 4);
+            i += 4;
+        }
+        if (N - i >= 2) {
+            uint16_t w = x >> (8 * i);
+            memcpy(bytes + i, &w, 2);
+            i += 2;
+        }
+        if (N - i >= 1) bytes[i] = x >> (8 * i);
+    }
+
+    operator uint64_t() const
+    {
+        uint64_t x = 0;
+        int i = 0;
+        if (N - i >= 4) {
+            uint32_t w;
+            memcpy(&w, bytes + i, 4);
+            x |= (uint64_t) w << (8 * i);
+            i += 4;
+        }
+        if (N - i >= 2) {
+            uint16_t w;
+            memcpy(&w, bytes + i, 2);
+            x |= (uint64_t) w << (8 * i);
+            i += 2;
+        }
+        if (N - i >= 1) x |= (uint64_t) bytes[i] << (8 * i);
+        return x;
+    }
+};
+typedef PackedSymbol<3> packed24;
+typedef PackedSymbol<5> packed40;
+typedef PackedSymbol<6> packed48;
+static_assert(sizeof(packed24) == 3 && sizeof(packed40) == 5 && sizeof(packed48) == 6,
+              "packed symbols must not be padded");
+
+// Whether -w takes this width in bits: 8, 16, 24, 32, 40, 48 or 64.
+inline bool is_symbol_width(int bits)
+{
+    return bits == 8 || bits == 16 || bits == 24 || bits == 32
+           || bits == 40 || bits == 48 || bits == 64;
+}
+
+/* A read-only array of symbols: a pointer and a length. Everything is
+ * defined right here so that indexing compiles down to a plain load in
+ * the parser's binary searches and the unparser's copy loops, without LTO.
+ * A view doesn't own its memory, which can come from a FileReader, a
+ * MappedFile or anything else that outlives it, and it's cheap to pass by
+ * value. Compiling with -DRLZ_BOUNDS_CHECK checks every access. */
+void symbol_view_out_of_bounds(long long i, long long size); // aborts
+
+template <typename T> class SymbolView {
+private:
+    const T* ptr;
+    long long len;
+
+public:
+    SymbolView() : ptr(NULL), len(0) {}
+    SymbolView(const T* data, long long size) : ptr(data), len(size) {}
+
+    T operator[](long long i) const {
+#ifdef RLZ_BOUNDS_CHECK
+        if (i < 0 || i >= len) symbol_view_out_of_bounds(i, len);
+#endif
+        return ptr[i];
+    }
+    long long size() const { return len; }
+    const T* data() const { return ptr; }
+};
+
+/* A whole file, or a part of one such as a section of an .rlzdict bundle
+ * (see below): offset and length in bytes, with length -1 meaning up to
+ * the end of the file. A plain file name converts to the whole file. */
+struct FileSection {
+    std::string file_name;
+    uint64_t offset;
+    long long length;
+
+    FileSection(std::string file_name, uint64_t offset = 0, long long length = -1)
+        : file_name(file_name), offset(offset), length(length) {}
+};
+
+/* Textual representation of a symbol, as in FileReader::as_string():
+ * printable ASCII or an escape for bytes, hex for wider symbols. */
+template <typename T> std::string symbol_as_string(T sym);
+
 // Read byte-mode input but interpret it as different-width unsigned ints.
-// The file is read into memory as soon as an instance is constructed.
+// The file (or a section of it) is read into memory as soon as an instance
+// is constructed (or with ALLOC_MMAP, mapped).
 template <typename T> class FileReader {
 private:
     std::ifstream infile;
     long long file_size_bytes;
     long long file_size_symbols; // in units of T, = file_size_bytes/sizeof(T)
     T* data_array;
+    int alloc_mode;    // ALLOC_* flags, what we actually got, not what was asked
+    size_t alloc_size; // bytes; rounded up to a page size if not ALLOC_HEAP
 
 public:
+    PhaseTime load_time; // how long the constructor took to read the file
+
     /* verbose = true turns on statements like "error: can't open file"
      * and "reading <filename>" and "read <n> symbols". */
-    FileReader(std::string filename, bool verbose = false);
+    FileReader(FileSection file, bool verbose = false,
+               int alloc_mode = ALLOC_HEAP);
+
+    long long size() { return file_size_symbols; } // size in units of T
+    T operator[](long long i) { return data_array[i]; }
+    const T* data() { return data_array; }
 
-    long long size(); // size in units of T
-    T operator[](long long i); // main mechanism of access to data
+    // The main mechanism of access to the data, once it's been read.
+    SymbolView<T> view() { return SymbolView<T>(data_array, file_size_symbols); }
 
     /* access a single index, return a textual representation of it; used in
      * early debug days for e.g. providing hex representation of uint32 */
     std::string as_string(long long i);
+
+    /* Number of bytes of the array that the kernel has actually backed with
+     * huge pages, found by reading /proc/self/smaps; 0 if not on Linux. */
+    long long huge_page_bytes();
+
+    /* One-line human-readable summary of the above, like
+     * "1024 MiB, 1020 MiB in huge pages (THP)". */
+    std::string memory_report();
 };
 
 template class FileReader<uint8_t>;
 template class FileReader<uint16_t>;
 template class FileReader<uint32_t>;
 template class FileReader<uint64_t>;
+template class FileReader<packed24>;
+template class FileReader<packed40>;
+template class FileReader<packed48>;
+
+
+// splitmix64's finalizer, for hashing symbols.
+inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/* Which symbols occur in the dictionary, so that rlzparse can output a
+ * literal without binary searching the whole suffix array for a symbol that
+ * isn't there. For 8- and 16-bit symbols this is exact: one bit for each
+ * possible symbol. Wider symbols go into a Bloom filter, which may say yes
+ * for an absent symbol, and then the search finds the literal as before.
+ * The bits are either built from the dictionary, or load()ed as they were
+ * stored in an .rlzdict bundle, from words().
+ * The Bloom filter has SYMBOL_FILTER_BITS_PER_SYMBOL bits per dictionary
+ * symbol (rounded up to a power of two) and SYMBOL_FILTER_HASHES hash
+ * functions, which misses ~3% of absent symbols if all are distinct. */
+#define SYMBOL_FILTER_BITS_PER_SYMBOL 8
+#define SYMBOL_FILTER_HASHES 3
+
+template <typename T>
+class SymbolFilter {
+    std::vector<uint64_t> own_bits; // when built here
+    const uint64_t* bits;
+    uint64_t n_bits;
+    uint64_t mask; // bit index mask for the Bloom filter; 0 if exact
+    bool exact;
+
+    void set(uint64_t i) { own_bits[i >> 6] |= 1ULL << (i & 63); }
+    bool get(uint64_t i) const { return (bits[i >> 6] >> (i & 63)) & 1; }
+
+    void size_for(long long dict_size)
+    {
+        exact = sizeof(T) <= 2;
+        if (exact) {
+            n_bits = sizeof(T) == 1 ? 256 : 65536;
+        } else {
+            n_bits = 64;
+            while (n_bits < (uint64_t) dict_size * SYMBOL_FILTER_BITS_PER_SYMBOL)
+                n_bits <<= 1;
+        }
+        mask = exact ? 0 : n_bits - 1;
+    }
+
+public:
+    SymbolFilter() : bits(NULL), n_bits(0), mask(0), exact(true) {}
+    SymbolFilter(const SymbolFilter&) = delete;
+    SymbolFilter& operator=(const SymbolFilter&) = delete;
+
+    void build(SymbolView<T> dict)
+    {
+        size_for(dict.size());
+        own_bits.assign(n_bits / 64, 0);
+        bits = own_bits.data();
+        for (long long i = 0; i < dict.size(); i++) {
+            if (exact) {
+                set((uint64_t) dict[i]);
+                continue;
+            }
+            uint64_t h1 = mix64((uint64_t) dict[i]);
+            uint64_t h2 = (h1 >> 32 | h1 << 32) | 1;
+            for (int k = 0; k < SYMBOL_FILTER_HASHES; k++)
+                set((h1 + k * h2) & mask);
+        }
+    }
+
+    /* Uses stored bits without copying them; they must outlive this.
+     * False if there are the wrong number of them for the dictionary. */
+    bool load(SymbolView<uint64_t> stored, long long dict_size)
+    {
+        size_for(dict_size);
+        if ((uint64_t) stored.size() != n_bits / 64) return false;
+        own_bits.clear();
+        bits = stored.data();
+        return true;
+    }
+
+    SymbolView<uint64_t> words() const { return SymbolView<uint64_t>(bits, n_bits / 64); }
+
+    // False means the symbol is certainly not in the dictionary.
+    bool may_contain(T sym) const
+    {
+        if (exact) return get((uint64_t) sym);
+        uint64_t h1 = mix64((uint64_t) sym);
+        uint64_t h2 = (h1 >> 32 | h1 << 32) | 1;
+        for (int k = 0; k < SYMBOL_FILTER_HASHES; k++)
+            if (!get((h1 + k * h2) & mask)) return false;
+        return true;
+    }
+};
+
+
+/* A dictionary alphabet, made by rlztools.alphabet: the distinct symbols
+ * of a dictionary of wide symbols that has few of them, sorted, as 64-bit
+ * numbers. The dictionary itself is then stored as the symbols' ranks in
+ * the alphabet, in rank_width() bits, which keeps the suffix array as it
+ * was, since ranks sort like the symbols. rlzparse --alphabet turns input
+ * symbols into ranks as it reads them, and rlzunparse --alphabet turns
+ * the ranks of the dictionary back into symbols as it copies them.
+ * Input symbols are looked up in a hash table rather than binary searched
+ * for, as there's one lookup for every symbol of the input: each of its
+ * slots is a rank + 1, or 0 if empty, and there are 2 to 4 times as many
+ * slots as symbols, probed linearly. */
+class Alphabet {
+    std::vector<uint64_t> symbols;
+    std::vector<uint32_t> slots;
+    uint64_t slot_mask;
+
+public:
+    /* Reads the alphabet file; false if it can't be read, or isn't sorted
+     * and without duplicates. */
+    bool load(std::string file_name);
+
+    uint64_t size() const { return symbols.size(); }
+    uint64_t symbol(uint64_t rank) const { return symbols[rank]; }
+
+    // The rank of sym, or size() (which no symbol has) if it isn't there.
+    uint64_t rank(uint64_t sym) const
+    {
+        for (uint64_t i = mix64(sym) & slot_mask; slots[i] != 0; i = (i + 1) & slot_mask) {
+            if (symbols[slots[i] - 1] == sym) return slots[i] - 1;
+        }
+        return symbols.size();
+    }
+
+    /* Bits in the narrowest of 8, 16 or 32-bit ranks that leave room for
+     * size() too; 0 if even 32 bits don't. */
+    int rank_width() const
+    {
+        if (size() < (1ULL << 8)) return 8;
+        if (size() < (1ULL << 16)) return 16;
+        if (size() < (1ULL << 32)) return 32;
+        return 0;
+    }
+
+    // Whether every symbol of dict is a rank in this alphabet.
+    template <typename T>
+    bool covers(SymbolView<T> dict) const
+    {
+        for (long long i = 0; i < dict.size(); i++)
+            if ((uint64_t) dict[i] >= size()) return false;
+        return true;
+    }
+};
+
+
+/* A packed suffix array file, made by rlztools.packsa, holds the suffix
+ * array's psi function instead of the array itself: psi[i] = ISA[SA[i] + 1],
+ * the rank of the suffix that's one symbol shorter (and for the last suffix,
+ * ISA[0]). psi increases through each range of suffixes starting with the
+ * same symbol, so its differences are small numbers, and on repetitive
+ * dictionaries mostly 1s. The suffix array comes back by following psi: if
+ * SA[i] = p then SA[psi[i]] = p + 1.
+ * The differences are vbyte coded in blocks of block_entries, and a number
+ * x stands for a run of (x >> 1) + 1 differences of 1 if x is odd, or for
+ * the difference zigzag_decode(x >> 1) if it's even. Each block starts
+ * from a psi value of its own, so the blocks are unpacked in parallel, and
+ * so is the walk along psi: ISA[p] is stored for every sample_rate'th p,
+ * and each thread starts from some of those. The walk overwrites each psi
+ * value with the SA entry as it goes, so no more memory is needed than for
+ * the suffix array itself. The file is a PackedSAHeader, the blocks'
+ * PackedSABlocks, the samples of ISA as 64-bit numbers, and then the
+ * blocks' codes; all in platform-native byte order. */
+#define PACKED_SA_MAGIC "RLZPSA1" /* and a NUL: 8 bytes */
+#define PACKED_SA_BLOCK 4096
+#define PACKED_SA_SAMPLE 4096
+
+struct PackedSAHeader {
+    char magic[8];
+    uint64_t n;             // entries in the suffix array
+    uint64_t block_entries;
+    uint64_t sample_rate;
+};
+
+struct PackedSABlock {
+    uint64_t offset; // of its codes, in bytes from the start of the header
+    uint64_t first;  // psi at its first entry
+};
+
+/* Writes sa packed into out; false on a write error. The suffix array
+ * isn't checked, and had better be right. */
+template <typename S>
+bool write_packed_sa(SymbolView<S> sa, std::ostream& out);
+
+/* Whether the file (at the section's offset) starts like a packed suffix
+ * array. */
+bool is_packed_sa(FileSection file);
+
+
+/* An .rlzdict bundle is a dictionary and its suffix array in one file,
+ * together with the tables rlzparse would otherwise build each time it
+ * starts, so that rlzparse and rlzunparse can map it as it is and get going
+ * at once. It starts with a DictBundleHeader, which says what the widths
+ * are and where each section is, and every section starts at a multiple of
+ * RLZDICT_ALIGN bytes, so that each can be mapped on its own. All numbers
+ * are in platform-native byte order, like suffix array files.
+ * rlztools.bundle writes them. The sections:
+ * RLZDICT_DICT: the dictionary's symbols, as in a plain dictionary file.
+ * RLZDICT_SA: its suffix array, as in a plain suffix array file.
+ * RLZDICT_FILTER: rlzparse's SymbolFilter for it, as 64-bit words.
+ * RLZDICT_KMERS: for each string x of param symbols, 2^RLZDICT_KMER_BITS in
+ *   all (so param is RLZDICT_KMER_BITS / symbol width), the number of
+ *   suffixes that sort before the first one starting with x, as 64-bit
+ *   words, and then the number of suffixes; the suffixes starting with x
+ *   are the SA range between two consecutive entries. A suffix shorter than
+ *   param symbols counts as if padded with zeros. Only for 8- and 16-bit
+ *   symbols.
+ * The first two are required; readers skip sections they don't know. */
+#define RLZDICT_MAGIC "RLZDICT" /* and a NUL: 8 bytes */
+#define RLZDICT_VERSION 1
+#define RLZDICT_ALIGN 4096
+#define RLZDICT_MAX_SECTIONS 16
+#define RLZDICT_KMER_BITS 16
+
+#define RLZDICT_DICT   1
+#define RLZDICT_SA     2
+#define RLZDICT_FILTER 3
+#define RLZDICT_KMERS  4
+
+struct DictBundleSection {
+    uint32_t type;   // RLZDICT_*
+    uint32_t param;  // width in bits for DICT and SA, symbols per key for KMERS
+    uint64_t offset; // bytes from the start of the file
+    uint64_t length; // bytes
+};
+
+struct DictBundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t symbol_width; // bits
+    uint32_t sa_width;     // bits
+    uint32_t n_sections;
+    DictBundleSection sections[RLZDICT_MAX_SECTIONS];
+};
+
+/* Reads the header of an .rlzdict bundle. Returns false if the file isn't
+ * one (doesn't start with RLZDICT_MAGIC), and exits with an error message
+ * if it can't be read or is one but is damaged. */
+bool read_dict_bundle(std::string filename, DictBundleHeader* header);
+
+// The bundle's section of the given type, or NULL if it has none.
+const DictBundleSection* dict_bundle_section(const DictBundleHeader* header,
+                                             uint32_t type);
+
+/* Where to read a section of type `type` from: in the bundle file_name if
+ * header isn't NULL, otherwise file_name is a plain file and all of it. */
+FileSection bundle_section(const DictBundleHeader* header,
+                           std::string file_name, uint32_t type);
 
 
 // Reads bytes from a file as input and produces RLZTokens.
@@ -95,6 +557,10 @@ private:
     RLZToken next_token_64x2();
     RLZToken next_token_ascii();
     RLZToken next_token_vbyte();
+    RLZToken next_token_delta();
+
+    bool next_number_vbyte(uint64_t* n); // false at the end of the file
+    uint64_t delta_prev_end; // for -f delta
 
 public:
     /* Unlike FileReader, doesn't immediately read in the file when
@@ -104,6 +570,19 @@ public:
     RLZInputReader(std::string filename, int input_mode);
     RLZToken next_token();
 
+    /* For files with --literal-runs: set literal_width to the size of
+     * a symbol in bytes, and after each length-0 token from next_token(),
+     * read_literals() the token's start_pos symbols into dest. Exits if
+     * the file ends in the middle of the run. */
+    int literal_width; // 0 if the file has no literal runs
+    void read_literals(void* dest, uint64_t count);
+
+    /* For PhraseIndex: the byte offset of the next token, and jumping to
+     * one, with the -f delta state (the previous phrase's end) it had. */
+    uint64_t position();
+    uint64_t delta_state() { return delta_prev_end; }
+    void seek(uint64_t offset, uint64_t delta_state);
+
     /* Read loops in rlzunparse don't rely entirely on next_token():
      * this function basically just does (infile.eof() || infile.fail()).
      * It fixed some off-by-one bug where we did one loop too many,
@@ -113,4 +592,194 @@ public:
 };
 
 
+/* A whole file mapped read-only into memory, for tools that want to go
+ * through RLZ files with several threads at once. Exits with an error
+ * message if the file can't be opened. An empty file has data() == NULL. */
+class MappedFile {
+private:
+    const uint8_t* data_ptr;
+    size_t size_bytes;
+
+public:
+    MappedFile(std::string filename);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() { return data_ptr; }
+    size_t size() { return size_bytes; }
+};
+
+/* Decodes RLZ tokens out of a memory buffer, like RLZInputReader does out of
+ * a file; a buffer can be a whole MappedFile or any part of one that starts
+ * on a token boundary. next() returns how many bytes the token took up,
+ * or 0 at the end of the buffer (and a partial token there is ignored).
+ * With literal_width set, as in RLZInputReader, a length-0 token is a run
+ * of start_pos literals, which next() skips over and counts in its bytes. */
+class RLZBufferReader {
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+    int mode;
+    uint64_t delta_prev_end; // for -f delta, which can't start mid-file
+
+    bool next_number_ascii(uint64_t* n);
+    bool next_number_vbyte(uint64_t* n);
+
+public:
+    RLZBufferReader(const uint8_t* begin, const uint8_t* end, int input_mode);
+    size_t next(RLZToken* token);
+    int literal_width; // 0 if the file has no literal runs
+};
+
+/* One bit per dictionary symbol, set for the symbols that some phrase
+ * copies; several threads can mark() at once. */
+class CoverageBitmap {
+private:
+    std::atomic<uint64_t>* words;
+    uint64_t n_bits;
+
+public:
+    CoverageBitmap(uint64_t n);
+    ~CoverageBitmap();
+    CoverageBitmap(const CoverageBitmap&) = delete;
+    CoverageBitmap& operator=(const CoverageBitmap&) = delete;
+
+    uint64_t size() { return n_bits; }
+    void mark(uint64_t from, uint64_t to); // sets bits [from, to)
+    bool mark_one(uint64_t i); // sets bit i; false if it was already set
+    uint64_t count(uint64_t from, uint64_t to); // set bits in [from, to)
+
+    /* Writes the bitmap as 64-bit words in machine byte order, lowest bit
+     * first; returns false on a write error. */
+    bool write(std::ostream& out);
+};
+
+
+/* Random access into an RLZ file: for any position of the uncompressed
+ * text, which token it's in, and where in the file that token is.
+ * The ends of the phrases (the number of symbols up to and including
+ * each token) are an increasing sequence, stored with Elias-Fano coding
+ * in about 2 + log2(symbols / tokens) bits per token: the low bits of each
+ * end as they are, and the high bits as a bit vector where the i'th end
+ * sets bit (end >> low_bits) + i. Every PHRASE_INDEX_SELECT_SAMPLE'th one
+ * and zero of that is sampled at load time, so finding the token for a
+ * position takes a select0 and a short scan.
+ * In 32x2 and 64x2, token t is at byte t * 8 or t * 16. The other formats
+ * need byte offsets, which are stored for every PHRASE_INDEX_INTERVAL'th
+ * token, together with the -f delta state there; one seeks to the last
+ * such token before the one wanted, and reads on from there.
+ * Index files start with PHRASE_INDEX_MAGIC, and are written by
+ * write_phrase_index() and read by the constructor, which exits with an
+ * error message if the file is no good. */
+#define PHRASE_INDEX_MAGIC 0x3169786564697a72ULL /* 'rlzidex1' */
+#define PHRASE_INDEX_INTERVAL 64
+#define PHRASE_INDEX_SELECT_SAMPLE 512
+
+class PhraseIndex {
+private:
+    uint64_t n_tokens;
+    uint64_t n_symbols;
+    int low_bits;
+    std::vector<uint64_t> low;   // n_tokens * low_bits bits
+    std::vector<uint64_t> high;  // n_tokens + (n_symbols >> low_bits) + 1 bits
+    std::vector<uint64_t> ones;  // position in high of every 512th one...
+    std::vector<uint64_t> zeros; // ...and zero
+    uint64_t high_bits;
+
+    uint64_t get_low(uint64_t i);
+    uint64_t select(bool one, uint64_t k); // position of the k'th (from 0)
+
+public:
+    int mode; // the FMT_* of the RLZ file
+    uint64_t interval; // 0 for 32x2 and 64x2 without literal runs, which don't need offsets
+    std::vector<uint64_t> offsets; // byte offset of token i * interval
+    std::vector<uint64_t> delta_states; // and the -f delta state there
+
+    PhraseIndex(std::string filename);
+
+    uint64_t tokens() { return n_tokens; }
+    uint64_t symbols() { return n_symbols; }
+    uint64_t phrase_end(uint64_t i); // symbols in tokens 0..i
+    uint64_t token_at(uint64_t pos); // the token with symbol pos (from 0)
+    uint64_t size_bytes();
+};
+
+/* Reads through an RLZ file twice and writes its PhraseIndex; literal_width
+ * is as in RLZInputReader. Exits with an error message on failure. */
+void write_phrase_index(std::string rlz_file_name, int mode,
+                        int literal_width, std::string index_file_name);
+
+
+/* Checks that a suffix array really is the suffix array of a dictionary,
+ * before hours of parsing end in a "failed binary search" error. That
+ * means the same number of entries as the dictionary has symbols, each
+ * entry in range and none repeated (so the array is a permutation), and
+ * each suffix comparing less than the next one, symbol by symbol as T,
+ * with a suffix that's a prefix of another counting as the smaller.
+ * The array is split between `threads` threads. T is the dictionary's
+ * symbol type and S the suffix array's, as in rlzparse. */
+struct SACheckResult {
+    bool size_mismatch;
+    uint64_t out_of_range; // entries not less than the dictionary size
+    uint64_t duplicates;   // entries that appear more than once
+    uint64_t misordered;   // i where suffix SA[i] isn't less than SA[i+1]
+    long long first_misordered; // the lowest such i, or -1
+    long long first_invalid;    // an out-of-range or repeated entry, or -1
+
+    bool ok() { return !size_mismatch && out_of_range == 0
+                       && duplicates == 0 && misordered == 0; }
+};
+
+template <typename T, typename S>
+SACheckResult check_suffix_array(SymbolView<T> dict, SymbolView<S> sa,
+                                 unsigned int threads);
+
+/* Prints out what was wrong on stderr, with "Error: " prefixed to each
+ * line; prints nothing if nothing was. */
+void print_sa_check_errors(SACheckResult* result);
+
+
+/* Hardware performance counters for this process, through Linux's
+ * perf_event_open(2). Counters the CPU or kernel won't give us (not Linux,
+ * no PMU in a VM, perf_event_paranoid too strict) read as -1, and if none
+ * of them work available() is false; nothing else changes, so callers can
+ * use this unconditionally. Only user-space events are counted. */
+#define PERF_CYCLES        0
+#define PERF_INSTRUCTIONS  1
+#define PERF_LLC_MISSES    2
+#define PERF_DTLB_MISSES   3
+#define PERF_BRANCH_MISSES 4
+#define PERF_N_EVENTS      5
+
+class PerfCounters {
+private:
+    int fds[PERF_N_EVENTS];
+    long long counts[PERF_N_EVENTS];
+
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available();
+    void start(); // zero the counters and start counting
+    void pause(); // leave something between start() and stop() uncounted
+    void resume();
+    void stop();  // stop counting and store the counts for get()
+
+    /* The count from the latest start()-stop() span, scaled up if the
+     * kernel had to multiplex counters; -1 if unavailable. */
+    long long get(int event);
+    static const char* name(int event); // "cycles", "llc_misses", ...
+
+    /* The counts for --stats reports: one line per counter, with the
+     * misses given per symbol (and instructions per cycle) as well;
+     * or a JSON object with null for unavailable counters. */
+    std::string report(uint64_t symbols);
+    std::string json();
+};
+
+
 #endif // include guard, RLZ_COMMON_H_INCLUDED
@@ -11,9 +11,11 @@
  *             each token.
  *
  * Basic usage:
- * rlzexplain -i infile.rlz [-d dictionary.rlz] [-f 32x2|64x2|ascii]
+ * rlzexplain -i infile.rlz [-d dictionary.rlz] [-f 32x2|64x2|vbyte|ascii|delta]
  *            [-w 8|16|32|64] [-l line-width] [--hex-addresses]
  *            [--hex-output] [--raw-bytes] [--utf8]
+ * rlzexplain --analyze -i infile.rlz [-d dictionary] [-f ...] [-w ...]
+ *            [--block-size N] [--region-size N] [-t threads] [--json]
  *
  * By default, doesn't print lines longer than 80 characters;
  * line width can be changed by e.g. -l 100, or -l 0 for unlimited width.
@@ -25,6 +27,11 @@
  * character sequences unescaped while escaping everything else.
  * For wider data, prints out a sequence of space-separated numbers,
  * in decimal unless --hex-output is given.
+ *
+ * With --analyze, prints aggregate statistics instead of the tokens:
+ * phrase length distribution, literal rate, how much of each block of the
+ * dictionary gets referenced, and the compression ratio in each region of
+ * the input. The dictionary is only needed for its size here.
  */
 
 #include <iostream>
@@ -33,6 +40,7 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <thread>
 #include <cstdlib>
 #include "rlzcommon.h"
 
@@ -49,6 +57,7 @@
 #endif
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 using std::hex;
 using std::dec;
@@ -66,12 +75,19 @@ void print_help() {
             "Usage: rlzexplain [options] -i INFILE.RLZ [-d DICTIONARY]\n"
             "Options:\n"
             "  -w, --width 8/16/32/64\tBit width of dictionary symbols, default=8.\n"
-            "  -f, --input-fmt 32x2/64x2/ascii\tFormat of RLZ file, default=32x2.\n"
+            "  -f, --input-fmt 32x2/64x2/vbyte/ascii/delta\tFormat of RLZ file, default=32x2.\n"
             "  -l N, --line-width N\tDefault 80, set to 0 for unlimited.\n"
             "  --hex-addresses\tPrint offset and length fields in hexadecimal.\n"
             "  --hex-output\tPrint referenced text as hex numbers, even for 8-bit data.\n"
             "  --raw-bytes\tFor 8-bit data, escape no non-ascii text.\n"
             "  --utf8\tFor 8-bit data, detect and don't escape valid UTF-8 sequences.\n"
+            "  --literal-runs\tThe file was made with rlzparse --literal-runs.\n"
+            "  --analyze\tPrint phrase statistics instead of the tokens themselves.\n"
+            "  --block-size N\tWith --analyze, dictionary block size in symbols;\n"
+            "\t\tdefault is 1/64 of the dictionary.\n"
+            "  --region-size N\tWith --analyze, input region size in symbols, default 1M.\n"
+            "  -t N, --threads N\tWith --analyze, threads to use; default is one per CPU.\n"
+            "  --json\tWith --analyze, print the statistics as a JSON object.\n"
             "(rlzexplain version" VERSION_STRING ", " DATE_STRING ")\n";
 }
 
@@ -95,7 +111,26 @@ int stream_print_char_maybe_escape(stringstream* ss, char c, bool dont_escape =
     }
 }
 
-void work_chars(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
+/* With --literal-runs, a length-0 token is followed by a run of n literals:
+ * reads them, and prints as many as fit on the line. */
+void print_literal_run(stringstream* ss, RLZInputReader* inputreader, uint64_t n,
+                       unsigned int line_width, bool raw_bytes)
+{
+    vector<uint8_t> run(n);
+    inputreader->read_literals(run.data(), n);
+    // round cur_len to the next multiple of 8 -- a tab stop.
+    unsigned int cur_len = (1 + ((-1 + ss->tellp()) >> 3)) << 3;
+    for (uint8_t c : run) {
+        // leave room for an escaped byte and the "..."
+        if (line_width > 0 && cur_len + 7 > line_width) {
+            (*ss) << "...";
+            break;
+        }
+        cur_len += stream_print_char_maybe_escape(ss, (char) c, raw_bytes);
+    }
+}
+
+void work_chars(RLZInputReader* inputreader, SymbolView<uint8_t> dict,
                 unsigned int line_width, bool hex_addresses, bool raw_bytes)
 {
     while (inputreader->keep_going()) {
@@ -107,8 +142,11 @@ void work_chars(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
         if (hex_addresses) ss << hex; else ss << dec;
         ss << tok.start_pos << "+" << tok.length << "\t";
 
-        long max_possible_length = dict->size() - tok.start_pos;
-        if (tok.length > max_possible_length) {
+        long max_possible_length = dict.size() - tok.start_pos;
+        if (tok.length == 0 && inputreader->literal_width > 0) {
+            print_literal_run(&ss, inputreader, tok.start_pos, line_width, raw_bytes);
+            goto printout;
+        } else if (tok.length > max_possible_length) {
             ss << "[length too long for dictionary]";
             goto printout;
         } else if (tok.length == 0) {
@@ -124,13 +162,13 @@ void work_chars(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
             stringstream last_5;
             unsigned int i = tok.start_pos + tok.length - END_WIDTH;
             while (i < tok.start_pos + tok.length) {
-                char c = (*dict)[i++];
+                char c = dict[i++];
                 stream_print_char_maybe_escape(&last_5, c, raw_bytes);
             }
             // Then do the start of the token.
             i = 0;
             while (cur_len < line_width - 3 - last_5.tellp() && i < tok.length) {
-                char c = (*dict)[tok.start_pos + i++];
+                char c = dict[tok.start_pos + i++];
                 cur_len += stream_print_char_maybe_escape(&ss, c, raw_bytes);
             }
             ss << "..." << last_5.str();
@@ -138,7 +176,7 @@ void work_chars(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
             int i = 0;
             while (i < tok.length && (cur_len < line_width || line_width == 0))
             {
-                char c = (*dict)[tok.start_pos + i++];
+                char c = dict[tok.start_pos + i++];
                 cur_len += stream_print_char_maybe_escape(&ss, c, raw_bytes);
             }
         }
@@ -152,7 +190,7 @@ void work_chars(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
 
 
 
-void work_utf8(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
+void work_utf8(RLZInputReader* inputreader, SymbolView<uint8_t> dict,
                unsigned int line_width, bool hex_addresses)
 {
     while (inputreader->keep_going()) {
@@ -164,8 +202,10 @@ void work_utf8(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
         if (hex_addresses) ss << hex; else ss << dec;
         ss << tok.start_pos << "+" << tok.length << "\t";
 
-        long max_possible_length = dict->size() - tok.start_pos;
-        if (tok.length > max_possible_length) {
+        long max_possible_length = dict.size() - tok.start_pos;
+        if (tok.length == 0 && inputreader->literal_width > 0) {
+            print_literal_run(&ss, inputreader, tok.start_pos, line_width, false);
+        } else if (tok.length > max_possible_length) {
             ss << "[length too long for dictionary]";
         } else if (tok.length == 0) {
             stream_print_char_maybe_escape(&ss, (char) tok.start_pos);
@@ -197,7 +237,7 @@ void work_utf8(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
             int i = 0;
             while (i < tok.length && (cur_len < line_width || line_width == 0))
             {
-                uint8_t c = (*dict)[tok.start_pos + i++];
+                uint8_t c = dict[tok.start_pos + i++];
                 if (bytebuf.size() == 0) {
                     // No sequence in progress.
                     if (c <= 127) {
@@ -282,8 +322,43 @@ void work_utf8(RLZInputReader* inputreader, FileReader<uint8_t>* dict,
 
 }
 
+/* Appends syms[from] to syms[from + n - 1] to ss as space-separated numbers,
+ * as many as fit on the line; cur_len is how much of the line is used. */
+template <typename T, typename Syms>
+void print_numbers(stringstream* ss, unsigned int cur_len, const Syms& syms,
+                   uint64_t from, long n, unsigned int line_len, bool hex_output)
+{
+    long i = 0;
+    while (i < n && (cur_len < line_len || line_len == 0)) {
+        T c = syms[from + i];
+        // we want to know the print width of the symbol
+        stringstream nbuf;
+        if (hex_output) nbuf << hex; else nbuf << dec;
+        // This numeric cast is necessary, because uint8_ts would
+        // otherwise just be printed as characters.
+        nbuf << (unsigned long long) c;
+        if (i < n - 1)
+            nbuf << ' '; // separator
+        if (line_len > 0 && cur_len + nbuf.tellp() > line_len) {
+            if (cur_len + 3 <= line_len) {
+                (*ss) << "...";
+            }
+            break;
+        } else {
+            (*ss) << nbuf.str();
+            cur_len += nbuf.tellp();
+        }
+        // convenience for 8-byte data
+        if (sizeof(T) == 1 && line_len > 0 && cur_len + 5 >= line_len && i < n - 1) {
+            (*ss) << "...";
+            break;
+        }
+        i++;
+    }
+}
+
 template <typename T>
-void work_numeric(RLZInputReader* inputreader, FileReader<T>* dict,
+void work_numeric(RLZInputReader* inputreader, SymbolView<T> dict,
                 unsigned int line_len, bool hex_addresses, bool hex_output)
 {
     while (inputreader->keep_going()) {
@@ -297,44 +372,23 @@ void work_numeric(RLZInputReader* inputreader, FileReader<T>* dict,
         // round cur_len to the next multiple of 8 -- a tab stop.
         cur_len = (1 + ((-1 + ss.tellp()) >> 3)) << 3;
 
-        long max_possible_length = dict->size() - tok.start_pos;
-        if (tok.length > max_possible_length) {
+        long max_possible_length = dict.size() - tok.start_pos;
+        if (tok.length == 0 && inputreader->literal_width > 0) {
+            vector<T> run(tok.start_pos);
+            inputreader->read_literals(run.data(), run.size());
+            print_numbers<T>(&ss, cur_len, run, 0, run.size(), line_len, hex_output);
+        } else if (tok.length > max_possible_length) {
             ss << "[length too long for dictionary]";
         } else if (tok.length == 0) {
             if (hex_output) ss << hex; else ss << dec;
             // this expression creates an all-ones literal as big as T
             ss << (tok.start_pos & ((1LL << (sizeof(T)*8))-1));
         } else {
-            int i = 0;
-            while (i < tok.length && (cur_len < line_len || line_len == 0)) {
-                T c = (*dict)[tok.start_pos + i];
-                // we want to know the print width of the symbol
-                stringstream nbuf;
-                if (hex_output) nbuf << hex; else nbuf << dec;
-                // This numeric cast is necessary, because uint8_ts would
-                // otherwise just be printed as characters.
-                nbuf << (unsigned long long) c;
-                if (i < tok.length - 1)
-                    nbuf << ' '; // separator
-                if (cur_len + nbuf.tellp() > line_len) {
-                    if (cur_len + 3 <= line_len) {
-                        ss << "...";
-                    }
-                    break;
-                } else {
-                    ss << nbuf.str();
-                    cur_len += nbuf.tellp();
-                }
-                // convenience for 8-byte data
-                if (sizeof(T) == 1 && cur_len + 5 >= line_len && i < tok.length - 1) {
-                    ss << "...";
-                    break;
-                }
-                i++;
-            }
-            ss << "\n";
-            cout << ss.str();
+            print_numbers<T>(&ss, cur_len, dict, tok.start_pos, tok.length,
+                             line_len, hex_output);
         }
+        ss << "\n";
+        cout << ss.str();
     }
 }
 
@@ -349,7 +403,348 @@ void print_plain_input(RLZInputReader* inputreader, bool hex_addresses) {
         if (is_end_sentinel(&tok))
             break;
         cout << tok.start_pos << "+" << tok.length << "\n";
+        if (tok.length == 0 && inputreader->literal_width > 0) {
+            // a run of literals: only the token is printed
+            vector<uint8_t> run(tok.start_pos * inputreader->literal_width);
+            inputreader->read_literals(run.data(), tok.start_pos);
+        }
+    }
+}
+
+
+/***** --analyze *****/
+
+/* Aggregate statistics over a whole RLZ file, for finding out where a
+ * dictionary is weak: which parts of it get used, and which parts of the
+ * input compress badly and might deserve more samples.
+ *
+ * The file is mapped into memory and cut into one chunk per thread, each
+ * starting at a token boundary. Two passes are made over the chunks: the
+ * first only adds up how many symbols each chunk decodes to, so that each
+ * chunk's starting position in the uncompressed text is known, and the
+ * second collects everything else, including the per-region numbers that
+ * depend on that position. Each thread keeps its own counts, which are
+ * added together at the end, except for the dictionary coverage bitmap,
+ * which is shared and set with atomic ORs. */
+
+// Without --block-size, the dictionary is split into this many blocks.
+#define DEFAULT_DICT_BLOCKS 64
+// Without --region-size, input regions are this many symbols long.
+#define DEFAULT_REGION_SIZE (1024 * 1024)
+
+struct AnalysisOptions {
+    int input_mode;
+    int symbol_width_bits;
+    int literal_width; // bytes per literal with --literal-runs, or 0
+    long long dict_size;  // in symbols, or 0 if no dictionary was given
+    long long block_size; // in dictionary symbols
+    long long region_size; // in input symbols
+    unsigned int threads;
+    bool json;
+};
+
+// One thread's counts; see merge().
+struct AnalysisCounts {
+    uint64_t tokens;
+    uint64_t literals; // symbols, so a run of literals counts as its length
+    uint64_t literal_runs; // with --literal-runs, the tokens that are runs
+    uint64_t symbols; // uncompressed
+    uint64_t bytes;   // of RLZ file
+    uint64_t out_of_range; // phrases that run past the end of the dictionary
+    uint64_t length_histogram[LENGTH_HISTOGRAM_BUCKETS];
+    vector<uint64_t> block_refs;    // phrases starting in each dictionary block
+    vector<uint64_t> block_symbols; // symbols copied out of each block
+    vector<uint64_t> region_tokens; // per input region, by where tokens start
+    vector<uint64_t> region_literals;
+    vector<uint64_t> region_bytes;
+
+    AnalysisCounts(size_t n_blocks, size_t n_regions)
+        : tokens(0), literals(0), literal_runs(0), symbols(0), bytes(0), out_of_range(0),
+          length_histogram(),
+          block_refs(n_blocks), block_symbols(n_blocks),
+          region_tokens(n_regions), region_literals(n_regions),
+          region_bytes(n_regions) {}
+
+    void merge(const AnalysisCounts& other)
+    {
+        tokens += other.tokens;
+        literals += other.literals;
+        literal_runs += other.literal_runs;
+        symbols += other.symbols;
+        bytes += other.bytes;
+        out_of_range += other.out_of_range;
+        for (int b = 0; b < LENGTH_HISTOGRAM_BUCKETS; b++)
+            length_histogram[b] += other.length_histogram[b];
+        for (size_t i = 0; i < block_refs.size(); i++) {
+            block_refs[i] += other.block_refs[i];
+            block_symbols[i] += other.block_symbols[i];
+        }
+        for (size_t i = 0; i < region_tokens.size(); i++) {
+            region_tokens[i] += other.region_tokens[i];
+            region_literals[i] += other.region_literals[i];
+            region_bytes[i] += other.region_bytes[i];
+        }
+    }
+};
+
+/* Cuts data[0..size) into n pieces that start at token boundaries, which
+ * are returned as n + 1 offsets. Fixed-width formats are easy. For vbyte,
+ * a token is two numbers and each number ends in a byte with the high bit
+ * clear, so a token starts after every even-numbered such byte: the
+ * threads first count those bytes in their piece, and from the running
+ * totals each one knows where its first whole token starts. ascii isn't
+ * split at all, and neither is delta, whose positions depend on every
+ * phrase before them. */
+static vector<size_t> split_at_tokens(const uint8_t* data, size_t size,
+                                      int mode, unsigned int n)
+{
+    vector<size_t> bounds(n + 1, size);
+    bounds[0] = 0;
+    if (mode == FMT_32X2 || mode == FMT_64X2) {
+        size_t record = mode == FMT_32X2 ? 8 : 16;
+        size_t records = size / record;
+        for (unsigned int i = 1; i < n; i++)
+            bounds[i] = records * i / n * record;
+        bounds[n] = records * record;
+    } else if (mode == FMT_VBYTE) {
+        vector<uint64_t> ends(n + 1, 0); // number-ending bytes before piece i
+        vector<std::thread> threads;
+        for (unsigned int i = 0; i < n; i++) {
+            threads.push_back(std::thread([&, i]() {
+                uint64_t count = 0;
+                for (size_t j = size * i / n; j < size * (i + 1) / n; j++)
+                    count += !(data[j] & 0x80);
+                ends[i + 1] = count;
+            }));
+        }
+        for (std::thread& t : threads) t.join();
+        for (unsigned int i = 1; i < n; i++) {
+            ends[i] += ends[i - 1];
+            size_t p = size * i / n;
+            uint64_t k = ends[i];
+            if (p > 0 && (data[p - 1] & 0x80)) { // mid-number: skip its end
+                while (p < size && (data[p] & 0x80)) p++;
+                p++;
+                k++;
+            }
+            if (k % 2 == 1) { // at a length: skip it too
+                while (p < size && (data[p] & 0x80)) p++;
+                p++;
+            }
+            bounds[i] = p < size ? p : size;
+        }
+    } else {
+        for (unsigned int i = 1; i < n; i++)
+            bounds[i] = 0; // everything goes to the last piece
+    }
+    return bounds;
+}
+
+static void print_analysis(AnalysisOptions* opts, AnalysisCounts* c,
+                           CoverageBitmap* bitmap)
+{
+    double width_bytes = opts->symbol_width_bits / 8.0;
+    size_t n_blocks = c->block_refs.size();
+    uint64_t covered_total = opts->dict_size > 0
+                             ? bitmap->count(0, opts->dict_size) : 0;
+    double ratio = c->symbols > 0 ? c->bytes / (c->symbols * width_bytes) : 0;
+    /* Phrases and literals: the tokens there would be without --literal-runs,
+     * so that the rates come out the same with it. */
+    uint64_t parsed = c->tokens + c->literals
+                      - (opts->literal_width > 0 ? c->literal_runs : c->literals);
+    double literal_rate = parsed > 0 ? c->literals / (double) parsed : 0;
+    double mean_len = parsed > 0 ? c->symbols / (double) parsed : 0;
+
+    if (opts->json) {
+        cout << std::fixed << std::setprecision(6)
+             << "{\"tokens\": " << c->tokens << ", \"literals\": " << c->literals
+             << ", \"literal_runs\": " << c->literal_runs
+             << ", \"literal_rate\": " << literal_rate
+             << ", \"symbols\": " << c->symbols << ", \"rlz_bytes\": " << c->bytes
+             << ", \"ratio\": " << ratio << ", \"mean_length\": " << mean_len
+             << ", \"out_of_range\": " << c->out_of_range
+             << ", \"length_histogram\": [";
+        bool first = true;
+        for (int b = 0; b < LENGTH_HISTOGRAM_BUCKETS; b++) {
+            if (c->length_histogram[b] == 0) continue;
+            unsigned long long lo = b == 0 ? 0 : 1ULL << (b - 1);
+            unsigned long long hi = b == 0 ? 0 : lo * 2 - 1;
+            cout << (first ? "" : ", ") << "{\"min\": " << lo << ", \"max\": " << hi
+                 << ", \"count\": " << c->length_histogram[b] << "}";
+            first = false;
+        }
+        cout << "]";
+        if (opts->dict_size > 0) {
+            cout << ", \"dict_size\": " << opts->dict_size
+                 << ", \"dict_covered\": " << covered_total
+                 << ", \"block_size\": " << opts->block_size << ", \"blocks\": [";
+            for (size_t i = 0; i < n_blocks; i++) {
+                long long start = i * opts->block_size;
+                long long len = MIN(opts->block_size, opts->dict_size - start);
+                cout << (i == 0 ? "" : ", ") << "{\"start\": " << start
+                     << ", \"refs\": " << c->block_refs[i]
+                     << ", \"symbols\": " << c->block_symbols[i]
+                     << ", \"covered\": " << bitmap->count(start, start + len)
+                     << "}";
+            }
+            cout << "]";
+        }
+        cout << ", \"region_size\": " << opts->region_size << ", \"regions\": [";
+        for (size_t i = 0; i < c->region_tokens.size(); i++) {
+            uint64_t len = MIN((uint64_t) opts->region_size, c->symbols - i * opts->region_size);
+            cout << (i == 0 ? "" : ", ") << "{\"start\": " << i * opts->region_size
+                 << ", \"tokens\": " << c->region_tokens[i]
+                 << ", \"literals\": " << c->region_literals[i]
+                 << ", \"rlz_bytes\": " << c->region_bytes[i]
+                 << ", \"ratio\": " << (len > 0 ? c->region_bytes[i] / (len * width_bytes) : 0)
+                 << "}";
+        }
+        cout << "]}" << endl;
+        return;
+    }
+
+    cout << std::fixed << std::setprecision(2)
+         << c->tokens << " tokens, " << c->literals << " literals ("
+         << literal_rate * 100 << "%";
+    if (opts->literal_width > 0)
+        cout << " in " << c->literal_runs << " runs";
+    cout << "), mean phrase length " << mean_len << "\n"
+         << c->symbols << " symbols in " << c->bytes << " bytes, out/in ratio "
+         << ratio * 100 << "%\n";
+    if (c->out_of_range > 0)
+        cout << c->out_of_range << " phrases run past the end of the dictionary\n";
+    cout << "\nphrase lengths:\n";
+    for (int b = 0; b < LENGTH_HISTOGRAM_BUCKETS; b++) {
+        if (c->length_histogram[b] == 0) continue;
+        string range = "literal";
+        if (b == 1) range = "1";
+        else if (b > 1)
+            range = std::to_string(1ULL << (b - 1)) + "-"
+                    + std::to_string((1ULL << (b - 1)) * 2 - 1);
+        cout << "  " << std::left << std::setw(14) << range << std::right
+             << std::setw(12) << c->length_histogram[b] << "  "
+             << 100.0 * c->length_histogram[b] / parsed << "%\n";
+    }
+    if (opts->dict_size > 0) {
+        cout << "\ndictionary: " << opts->dict_size << " symbols, "
+             << 100.0 * covered_total / opts->dict_size << "% referenced; "
+             << opts->block_size << "-symbol blocks:\n"
+             << "  " << std::setw(12) << "start" << std::setw(12) << "phrases"
+             << std::setw(14) << "symbols out" << std::setw(10) << "covered" << "\n";
+        for (size_t i = 0; i < n_blocks; i++) {
+            long long start = i * opts->block_size;
+            long long len = MIN(opts->block_size, opts->dict_size - start);
+            cout << "  " << std::setw(12) << start << std::setw(12) << c->block_refs[i]
+                 << std::setw(14) << c->block_symbols[i] << std::setw(9)
+                 << 100.0 * bitmap->count(start, start + len) / len << "%\n";
+        }
+    }
+    cout << "\ninput: " << opts->region_size << "-symbol regions:\n"
+         << "  " << std::setw(12) << "start" << std::setw(12) << "tokens"
+         << std::setw(12) << "literals" << std::setw(12) << "rlz bytes"
+         << std::setw(9) << "ratio" << "\n";
+    for (size_t i = 0; i < c->region_tokens.size(); i++) {
+        uint64_t len = MIN((uint64_t) opts->region_size, c->symbols - i * opts->region_size);
+        cout << "  " << std::setw(12) << i * opts->region_size
+             << std::setw(12) << c->region_tokens[i]
+             << std::setw(12) << c->region_literals[i]
+             << std::setw(12) << c->region_bytes[i] << std::setw(8)
+             << (len > 0 ? 100.0 * c->region_bytes[i] / (len * width_bytes) : 0) << "%\n";
+    }
+}
+
+// Uncompressed symbols in a token: a literal is one, a run of them start_pos.
+static uint64_t token_symbols(RLZToken tok, AnalysisOptions* opts)
+{
+    if (tok.length > 0) return tok.length;
+    return opts->literal_width > 0 ? tok.start_pos : 1;
+}
+
+static void analyze(string input_file_name, AnalysisOptions* opts)
+{
+    MappedFile file(input_file_name);
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+
+    // Literal runs, like ascii and delta, can't be split without reading them.
+    unsigned int n = opts->input_mode == FMT_ASCII || opts->input_mode == FMT_DELTA
+                     || opts->literal_width > 0 ? 1 : opts->threads;
+    vector<size_t> bounds = opts->literal_width > 0 ? vector<size_t>{0, size}
+                            : split_at_tokens(data, size, opts->input_mode, n);
+
+    // Pass 1: symbols per chunk, and from them each chunk's start position.
+    vector<uint64_t> chunk_start(n + 1, 0);
+    vector<std::thread> threads;
+    for (unsigned int i = 0; i < n; i++) {
+        threads.push_back(std::thread([&, i]() {
+            RLZBufferReader cur(data + bounds[i], data + bounds[i + 1], opts->input_mode);
+            cur.literal_width = opts->literal_width;
+            RLZToken tok;
+            uint64_t symbols = 0;
+            while (cur.next(&tok) > 0)
+                symbols += token_symbols(tok, opts);
+            chunk_start[i + 1] = symbols;
+        }));
     }
+    for (std::thread& t : threads) t.join();
+    threads.clear();
+    for (unsigned int i = 1; i <= n; i++)
+        chunk_start[i] += chunk_start[i - 1];
+
+    // Pass 2: everything else.
+    size_t n_blocks = opts->dict_size > 0
+                      ? (opts->dict_size + opts->block_size - 1) / opts->block_size : 0;
+    size_t n_regions = (chunk_start[n] + opts->region_size - 1) / opts->region_size;
+    CoverageBitmap bitmap(opts->dict_size);
+    vector<AnalysisCounts> counts(n, AnalysisCounts(n_blocks, n_regions));
+    for (unsigned int i = 0; i < n; i++) {
+        threads.push_back(std::thread([&, i]() {
+            RLZBufferReader cur(data + bounds[i], data + bounds[i + 1], opts->input_mode);
+            cur.literal_width = opts->literal_width;
+            AnalysisCounts* c = &counts[i];
+            uint64_t out_pos = chunk_start[i];
+            RLZToken tok;
+            size_t bytes;
+            while ((bytes = cur.next(&tok)) > 0) {
+                uint64_t len = token_symbols(tok, opts);
+                size_t region = out_pos / opts->region_size;
+                c->tokens++;
+                c->symbols += len;
+                c->bytes += bytes;
+                // literals one by one, as rlzparse --stats counts them
+                c->length_histogram[length_histogram_bucket(tok.length)]
+                    += tok.length == 0 ? len : 1;
+                c->region_tokens[region]++;
+                c->region_bytes[region] += bytes;
+                out_pos += len;
+                if (tok.length == 0) { // a literal, or a run of them
+                    c->literals += len;
+                    c->region_literals[region] += len;
+                    if (opts->literal_width > 0) c->literal_runs++;
+                    continue;
+                }
+                if (n_blocks == 0) continue;
+                uint64_t from = tok.start_pos, to = tok.start_pos + tok.length;
+                if (to > (uint64_t) opts->dict_size || to < from) {
+                    c->out_of_range++;
+                    to = opts->dict_size;
+                    if (from >= to) continue;
+                }
+                c->block_refs[from / opts->block_size]++;
+                for (uint64_t b = from / opts->block_size; b * opts->block_size < to; b++) {
+                    uint64_t lo = MAX(from, b * opts->block_size);
+                    uint64_t hi = MIN(to, (b + 1) * opts->block_size);
+                    c->block_symbols[b] += hi - lo;
+                }
+                bitmap.mark(from, to);
+            }
+        }));
+    }
+    for (std::thread& t : threads) t.join();
+    for (unsigned int i = 1; i < n; i++)
+        counts[0].merge(counts[i]);
+
+    print_analysis(opts, &counts[0], &bitmap);
 }
 
 
@@ -369,6 +764,12 @@ int main(int argc, char **argv) {
     bool hex_output = false;
     bool raw_bytes = false;
     bool utf8 = false;
+    bool analyze_mode = false;
+    bool literal_runs = false;
+    long long block_size = 0;
+    long long region_size = DEFAULT_REGION_SIZE;
+    unsigned int threads = std::thread::hardware_concurrency();
+    bool json = false;
 
     /* Argument parsing *****/
     int i = 1;
@@ -424,6 +825,35 @@ int main(int argc, char **argv) {
             raw_bytes = true;
         } else if (arg_i.compare("--utf8") == 0) {
             utf8 = true;
+        } else if (arg_i.compare("--analyze") == 0) {
+            analyze_mode = true;
+        } else if (arg_i.compare("--literal-runs") == 0) {
+            literal_runs = true;
+        } else if (arg_i.compare("--block-size") == 0 || arg_i.compare("--region-size") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no size given after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            long long n = atoll(argv[++i]);
+            if (n <= 0) {
+                cerr << "Bad arguments: " << arg_i << " must be positive\n";
+                exit(EXIT_USER_ERROR);
+            }
+            if (arg_i.compare("--block-size") == 0) block_size = n;
+            else region_size = n;
+        } else if (arg_i.compare("-t") == 0 || arg_i.compare("--threads") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no thread count given after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            int t = atoi(argv[++i]);
+            if (t <= 0) {
+                cerr << "Bad arguments: thread count must be positive\n";
+                exit(EXIT_USER_ERROR);
+            }
+            threads = (unsigned int) t;
+        } else if (arg_i.compare("--json") == 0) {
+            json = true;
         } else {
             cerr << "Unknown argument '" << arg_i << "'; give input file with -i.\n";
             exit(EXIT_USER_ERROR);
@@ -443,15 +873,43 @@ int main(int argc, char **argv) {
         input_mode = FMT_32X2;
     } else if (input_format.compare("64x2") == 0) {
         input_mode = FMT_64X2;
+    } else if (input_format.compare("vbyte") == 0) {
+        input_mode = FMT_VBYTE;
     } else if (input_format.compare("ascii") == 0) {
         input_mode = FMT_ASCII;
+    } else if (input_format.compare("delta") == 0) {
+        input_mode = FMT_DELTA;
     } else {
-        cerr << "Bad arguments: input format not \"32x2\", \"64x2\", or \"ascii\".\n";
+        cerr << "Bad arguments: input format not \"32x2\", \"64x2\", \"vbyte\", \"ascii\" or \"delta\".\n";
         exit(EXIT_USER_ERROR);
     }
     /* end argument parsing *****/
 
+    if (analyze_mode) {
+        AnalysisOptions opts;
+        opts.input_mode = input_mode;
+        opts.symbol_width_bits = symbol_width_bits;
+        opts.literal_width = literal_runs ? symbol_width_bits / 8 : 0;
+        opts.dict_size = 0;
+        if (dict_file_name.length() > 0) {
+            ifstream dict_file(dict_file_name, ifstream::binary);
+            if (!dict_file) {
+                cerr << "Error: can't open dictionary file " << dict_file_name << endl;
+                exit(EXIT_INVALID_INPUT);
+            }
+            opts.dict_size = file_size(&dict_file) / (symbol_width_bits / 8);
+        }
+        opts.block_size = block_size > 0 ? block_size
+                          : MAX(1, (opts.dict_size + DEFAULT_DICT_BLOCKS - 1) / DEFAULT_DICT_BLOCKS);
+        opts.region_size = region_size;
+        opts.threads = MAX(1u, threads);
+        opts.json = json;
+        analyze(input_file_name, &opts);
+        return 0;
+    }
+
     RLZInputReader ir(input_file_name, input_mode);
+    ir.literal_width = literal_runs ? symbol_width_bits / 8 : 0;
 
     if (dict_file_name.length() == 0) {
         print_plain_input(&ir, hex_addresses);
@@ -460,13 +918,14 @@ int main(int argc, char **argv) {
 
     switch (symbol_width_bits) {
     case 8: {
-        FileReader<uint8_t> dict = FileReader<uint8_t>(dict_file_name);
+        FileReader<uint8_t> dict_file = FileReader<uint8_t>(dict_file_name);
+        SymbolView<uint8_t> dict = dict_file.view();
         if (utf8) {
-            work_utf8(&ir, &dict, line_width, hex_addresses);
+            work_utf8(&ir, dict, line_width, hex_addresses);
         } else if (hex_output) {
-            work_numeric<uint8_t>(&ir, &dict, line_width, hex_addresses, hex_output);
+            work_numeric<uint8_t>(&ir, dict, line_width, hex_addresses, hex_output);
         } else {
-            work_chars(&ir, &dict, line_width, hex_addresses, raw_bytes);
+            work_chars(&ir, dict, line_width, hex_addresses, raw_bytes);
         }
         break;
     }
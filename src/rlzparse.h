@@ -0,0 +1,1500 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2023 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* The parser behind rlzparse: Parser, which finds the tokens, and
+ * output_token(), which writes them out in each format. rlzparse.cpp
+ * has the command line around them; bench/microbench.cpp times them. */
+#ifndef RLZ_PARSE_H_INCLUDED
+#define RLZ_PARSE_H_INCLUDED
+
+#include <deque>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+// Defines RLZToken and FileReader.
+#include "rlzcommon.h"
+
+// if asked for with --progress, print a message this many milliseconds
+#define PROGRESS_PRINT_INTERVAL_MS 5000
+
+// with --metrics-file, rewrite the file this often, checking the clock
+// only every METRICS_CHECK_TOKENS tokens
+#define METRICS_INTERVAL_MS 1000
+#define METRICS_CHECK_TOKENS 64
+
+// With --stats, tokens are found and written out in batches of this many,
+// so that the two can be timed separately without a clock call per token.
+#define STATS_BATCH_SIZE 4096
+
+// --verify checksums the input and its reconstruction with 64-bit FNV-1a.
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// --sparse-sa: each anchor's SA range is checked for a suffix that the
+// input before the anchor also matches, at most this many suffixes of it.
+#define SPARSE_SA_CANDIDATES 16
+
+// --sa-on-disk: SampledSA reads the suffix array in blocks of this many
+// bytes, keeps the first entry of each in memory along with this many
+// symbols of its suffix, and caches this many blocks.
+#define SA_DISK_BLOCK_BYTES 4096
+#define SA_SAMPLE_PREFIX 8
+#define SA_DISK_CACHE_BLOCKS 1024
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+using std::ifstream;
+using std::ofstream;
+using wall_clock = std::chrono::system_clock;
+using std::chrono::milliseconds;
+
+
+/* Literal tokens, for symbols in the input that aren't in the dictionary,
+ * are output as a token which has the symbol in the start_pos field and
+ * a length field of zero. This works for our purposes because a length of
+ * zero is otherwise nonsensical: why would one copy zero bytes from the
+ * dictionary? With --literal-runs, such a token starts a run of literals
+ * instead; see LITERAL_RUN_MAX in rlzcommon.h. */
+
+inline void error_die(string msg)
+{
+    cerr << msg << endl;
+    exit(EXIT_BUG);
+}
+
+/* A warning avoidance function safer than a plain cast: negatives are
+ * turned to zero rather than wrapping around into the quintillions. */
+inline unsigned long long unsign(long long i)
+{
+    if (i < 0) return 0UL;
+    return (unsigned long long) i;
+}
+
+
+
+// LEB128, as in -f vbyte; returns the number of bytes put in buf (max 10).
+inline int vbyte_encode(uint64_t n, char* buf)
+{
+    int len = 0;
+    while (n > 127) {
+        buf[len++] = (char) ((n & 0x7F) | 0x80);
+        n >>= 7;
+    }
+    buf[len++] = (char) n;
+    return len;
+}
+
+// Returns > 0 if the end token hasn't been seen yet, 0 if it's time to stop.
+// (Returned value is the token length in symbols, or 1 if it was a literal.)
+// Adds the number of bytes that are output to *bytes_output.
+// Does not check that all lengths are nonnegative -- they should be, anyway.
+// -f delta phrases also need *delta_prev_end, the end of the previous
+// phrase (0 at first), which this updates.
+inline unsigned long output_token(
+        RLZToken token, std::ostream* out,
+        int output_mode, uint64_t* bytes_output,
+        uint64_t* delta_prev_end = NULL)
+{
+    if (is_end_sentinel(&token)) {
+        out->flush();
+        return 0; // end token seen
+    }
+    int64_t length_copy = token.length;
+    switch (output_mode) {
+        case FMT_32X2: {
+            char bytebuf[8];
+            uint32_t* intbuf = reinterpret_cast<uint32_t*>(bytebuf);
+            intbuf[0] = (uint32_t) token.start_pos;
+            intbuf[1] = (uint32_t) token.length;
+            // ostream::write doesn't work because it needs const
+            for (int i = 0; i < 8; i++) out->put(bytebuf[i]);
+            *bytes_output += 8;
+            break;
+        }
+        case FMT_64X2: {
+            char bytebuf[16];
+            uint64_t* intbuf = reinterpret_cast<uint64_t*>(bytebuf);
+            intbuf[0] = (uint64_t) token.start_pos;
+            intbuf[1] = (uint64_t) token.length;
+            for (int i = 0; i < 16; i++) out->put(bytebuf[i]);
+            *bytes_output += 16;
+            break;
+        }
+        case FMT_ASCII: {
+            string outstring = std::to_string(token.start_pos) + " "
+                               + std::to_string(token.length) + "\n";
+            (*out) << outstring;
+            *bytes_output += outstring.length();
+            break;
+        }
+        case FMT_VBYTE: {
+            char bytebuf[20]; // vbyte-encoded 64-bit ints need at most 10 bytes
+            int bufptr = 0;
+            if (token.start_pos == 0)
+                bytebuf[bufptr++] = 0;
+            while (token.start_pos > 0) {
+                if (token.start_pos <= 127) {
+                    bytebuf[bufptr++] = (char) token.start_pos;
+                } else {
+                    char low_7 = token.start_pos & 0x7F;
+                    bytebuf[bufptr++] = low_7 | 0x80;
+                }
+                token.start_pos = token.start_pos >> 7;
+            }
+            if (token.length == 0)
+                bytebuf[bufptr++] = 0;
+            while (token.length > 0) {
+                if (token.length <= 127) {
+                    bytebuf[bufptr++] = (char) token.length;
+                } else {
+                    char low_7 = token.length & 0x7F;
+                    bytebuf[bufptr++] = low_7 | 0x80;
+                }
+                token.length = token.length >> 7;
+            }
+            for (int i = 0; i < bufptr; i++)
+                out->put(bytebuf[i]);
+            *bytes_output += bufptr;
+            break;
+        }
+        case FMT_DELTA: {
+            // see FMT_DELTA in rlzcommon.h
+            char bytebuf[20];
+            int bufptr;
+            uint64_t len = token.length;
+            if (len > 0 && delta_prev_end == NULL) {
+                cerr << "bug: output_token called without delta_prev_end\n";
+                exit(EXIT_BUG);
+            }
+            if (len > 0 && token.start_pos == *delta_prev_end) {
+                bufptr = vbyte_encode(len << 1 | 1, bytebuf);
+            } else {
+                bufptr = vbyte_encode(len << 1, bytebuf);
+                bufptr += vbyte_encode(len == 0 ? token.start_pos
+                                       : zigzag_encode(token.start_pos - *delta_prev_end),
+                                       bytebuf + bufptr);
+            }
+            if (len > 0)
+                *delta_prev_end = token.start_pos + len;
+            out->write(bytebuf, bufptr);
+            *bytes_output += bufptr;
+            break;
+        }
+        default: {
+            cerr << "bug: no output handler in output_token for mode 0x" << std::hex << output_mode << std::dec << endl;
+            exit(EXIT_BUG);
+        }
+    }
+    return length_copy > 0 ? length_copy : 1;
+}
+
+/* --literal-runs: writes a run of literals as a (count, 0) token followed
+ * by the symbols themselves, in machine byte order, or one per line in
+ * ascii. Adds the bytes written to *bytes_output. */
+template <typename T>
+void output_literal_run(const vector<T>& run, std::ostream* out,
+                        int output_mode, uint64_t* bytes_output)
+{
+    RLZToken header = {run.size(), 0};
+    output_token(header, out, output_mode, bytes_output);
+    if (output_mode == FMT_ASCII) {
+        for (T sym : run) {
+            string line = std::to_string((uint64_t) sym) + "\n";
+            (*out) << line;
+            *bytes_output += line.length();
+        }
+    } else {
+        out->write(reinterpret_cast<const char*>(run.data()), run.size() * sizeof(T));
+        *bytes_output += run.size() * sizeof(T);
+    }
+}
+
+
+// Prints progress bar if the progress bar printout time is up.
+// Assumes that cur_pos is 0-indexed, so its 100% value is max_pos-1.
+inline void print_progress(string filename, long long cur_pos, long long max_pos,
+                           bool force_print)
+{
+    static bool progress_msgs_initialized = false;
+    static wall_clock::time_point prev_print_time;
+    static long long pos_at_last_printout = 0;
+    if (!progress_msgs_initialized) {
+        prev_print_time = wall_clock::now();
+        progress_msgs_initialized = true;
+        force_print = true;
+    }
+    wall_clock::time_point now = wall_clock::now();
+    milliseconds time_elapsed = std::chrono::duration_cast<milliseconds>(now - prev_print_time);
+    if (time_elapsed.count() >= PROGRESS_PRINT_INTERVAL_MS || force_print) {
+        double progress_percent = (cur_pos + 1) * 100 / (double) max_pos;
+        long long bytes_processed = cur_pos - pos_at_last_printout;
+        long long bps = bytes_processed * 1000 / PROGRESS_PRINT_INTERVAL_MS;
+        string rate_string = std::to_string(bps) + " B/s";
+        if (bps > 9999 && bps <= 9999999) {
+            string s = std::to_string((double) bps / 1000);
+            rate_string = s.substr(0, s.length() - 3) + " kB/s";
+        } else if (bps > 9999999) { // 10 MB - 1
+            string s = std::to_string((double) bps / 1000000);
+            rate_string = s.substr(0, s.length() - 3) + " MB/s";
+        }
+        cerr << "\r" << filename << ": "
+             << std::fixed << std::setprecision(2) << progress_percent
+             << "%  " << rate_string << " "; // no newline on purpose
+        prev_print_time = now;
+        pos_at_last_printout = cur_pos;
+    }
+}
+
+
+// For file names in JSON output.
+inline string json_string(string s)
+{
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char) c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char) c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+
+/* --metrics-file: progress for job schedulers and monitoring scripts,
+ * which --progress's carriage-returned stderr lines aren't much use to.
+ * The file is a single JSON object, rewritten every METRICS_INTERVAL_MS
+ * and once more at the end with "state": "done". Each version is written
+ * under a temporary name first and renamed over the old one, so readers
+ * never see half a file. */
+class MetricsFile {
+private:
+    string file_name;
+    string tmp_file_name;
+    string input_file_name;
+    long long input_size; // bytes
+    wall_clock::time_point start_time;
+    wall_clock::time_point prev_write_time;
+    uint64_t bytes_at_prev_write;
+    uint64_t calls;
+    bool warned;
+
+public:
+    MetricsFile(string file_name, string input_file_name, long long input_size)
+    {
+        this->file_name = file_name;
+        tmp_file_name = file_name + ".tmp";
+        this->input_file_name = input_file_name;
+        this->input_size = input_size;
+        start_time = prev_write_time = wall_clock::now();
+        bytes_at_prev_write = 0;
+        calls = 0;
+        warned = false;
+        update(0, 0, 0, false);
+    }
+
+    // Cheap to call once per token: usually just counts the call.
+    void update(uint64_t bytes_in, uint64_t bytes_out, uint64_t tokens, bool done)
+    {
+        if (!done && calls++ % METRICS_CHECK_TOKENS != 0) return;
+        wall_clock::time_point now = wall_clock::now();
+        long long since_prev = std::chrono::duration_cast<milliseconds>(
+                                   now - prev_write_time).count();
+        if (!done && calls > 1 && since_prev < METRICS_INTERVAL_MS) return;
+
+        double elapsed = std::chrono::duration_cast<milliseconds>(
+                             now - start_time).count() / 1000.0;
+        double rate = since_prev > 0
+                      ? (bytes_in - bytes_at_prev_write) * 1000.0 / since_prev : 0;
+        double mean_rate = elapsed > 0 ? bytes_in / elapsed : 0;
+        ofstream out(tmp_file_name, ofstream::trunc);
+        out << std::fixed << std::setprecision(3)
+            << "{\"pid\": " << getpid()
+            << ", \"input\": " << json_string(input_file_name)
+            << ", \"state\": \"" << (done ? "done" : "parsing") << "\""
+            << ", \"updated_unix\": " << (long long) time(NULL)
+            << ", \"elapsed_s\": " << elapsed
+            << ", \"bytes_in\": " << bytes_in
+            << ", \"bytes_in_total\": " << input_size
+            << ", \"progress\": " << (input_size > 0 ? bytes_in / (double) input_size : 1.0)
+            << ", \"bytes_out\": " << bytes_out
+            << ", \"tokens\": " << tokens
+            << ", \"throughput_bps\": " << rate
+            << ", \"mean_throughput_bps\": " << mean_rate
+            << ", \"eta_s\": ";
+        if (done)
+            out << 0.0;
+        else if (mean_rate > 0)
+            out << (input_size - (long long) bytes_in) / mean_rate;
+        else
+            out << "null";
+        out << ", \"rss_bytes\": " << current_rss_bytes() << "}\n";
+        out.close();
+        if (!out || std::rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+            // Not worth stopping a long parse for.
+            if (!warned)
+                cerr << "Warning: can't write metrics file " << file_name << "\n";
+            warned = true;
+        }
+        prev_write_time = now;
+        bytes_at_prev_write = bytes_in;
+    }
+};
+
+
+/* --sa-on-disk: the suffix array stays on disk, for when it doesn't fit in
+ * memory. Binary searching a mapped SA file would fault in a new page at
+ * nearly every probe, so instead the first entry of every block (of
+ * SA_DISK_BLOCK_BYTES) is kept in memory, with the first SA_SAMPLE_PREFIX
+ * dictionary symbols of its suffix: the top of a string B-tree, roughly.
+ * narrow() searches these samples to cut a search range down to one block
+ * before the parser's binary search starts, so that each step of the
+ * search costs at most one block read, and those go through a small
+ * direct-mapped cache. Entries are read with [], like a SymbolView. */
+template <typename T, typename S>
+class SampledSA {
+    int fd;
+    long long n;        // entries in the suffix array
+    uint64_t base;      // where in the file it starts, in bytes
+    static const long long k = SA_DISK_BLOCK_BYTES / sizeof(S); // entries per block
+    vector<S> samples;  // sa[0], sa[k], sa[2k]...
+    vector<T> prefixes; // SA_SAMPLE_PREFIX symbols of each sample's suffix
+    vector<S> cache;    // SA_DISK_CACHE_BLOCKS blocks
+    vector<long long> cached_block; // the block in each cache slot, or -1
+    SymbolView<T> dict;
+
+    /* Compares the symbol `offset` into sample j's suffix to c: negative if
+     * it's smaller or the suffix has ended, 0 if equal, positive if bigger. */
+    int compare_sample(long long j, long long offset, T c) const
+    {
+        if ((uint64_t) samples[j] + offset >= (uint64_t) dict.size()) return -1;
+        T sym = offset < SA_SAMPLE_PREFIX ? prefixes[j * SA_SAMPLE_PREFIX + offset]
+                                          : dict[samples[j] + offset];
+        return sym < c ? -1 : sym > c ? 1 : 0;
+    }
+
+public:
+    uint64_t block_reads;
+    uint64_t sample_probes;
+
+    SampledSA(FileSection sa_file, SymbolView<T> dict)
+        : dict(dict), block_reads(0),
+          sample_probes(0)
+    {
+        fd = open(sa_file.file_name.c_str(), O_RDONLY);
+        if (fd < 0) error_die("Error: cannot open suffix array file " + sa_file.file_name);
+        base = sa_file.offset;
+        n = (sa_file.length >= 0 ? sa_file.length : lseek(fd, 0, SEEK_END)) / sizeof(S);
+        cache.resize(SA_DISK_CACHE_BLOCKS * k);
+        cached_block.assign(SA_DISK_CACHE_BLOCKS, -1);
+        // One pass through the file for the samples.
+        samples.reserve((n + k - 1) / k);
+        for (long long b = 0; b * k < n; b++) {
+            S* block = read_block(b);
+            samples.push_back(block[0]);
+        }
+        block_reads = 0;
+        prefixes.resize(samples.size() * SA_SAMPLE_PREFIX);
+        for (size_t j = 0; j < samples.size(); j++) {
+            for (long long o = 0; o < SA_SAMPLE_PREFIX && (uint64_t) samples[j] + o < (uint64_t) dict.size(); o++)
+                prefixes[j * SA_SAMPLE_PREFIX + o] = dict[samples[j] + o];
+        }
+    }
+    ~SampledSA() { close(fd); }
+
+    long long size() const { return n; }
+
+    S operator[](long long i)
+    {
+        if (i % k == 0) return samples[i / k];
+        return read_block(i / k)[i % k];
+    }
+
+    // Block b, from the cache or the file.
+    S* read_block(long long b)
+    {
+        long long slot = b % SA_DISK_CACHE_BLOCKS;
+        S* block = &cache[slot * k];
+        if (cached_block[slot] != b) {
+            long long entries = n - b * k < k ? n - b * k : k;
+            if (pread(fd, block, entries * sizeof(S), base + b * k * sizeof(S))
+                    != (ssize_t) (entries * sizeof(S))) {
+                error_die("Error: can't read the suffix array file");
+            }
+            cached_block[slot] = b;
+            block_reads++;
+        }
+        return block;
+    }
+
+    /* For Parser::search_left (left_side = true): shrink [*left, *right],
+     * whose suffixes all agree on their first `offset` symbols, to the
+     * one block (plus the next block's sample) where the first suffix
+     * with symbol c at `offset` must be if there is one. Likewise for
+     * search_right and the last such suffix. Either way, the new range's
+     * ends are either the old ones, or samples known not to be the answer,
+     * which the binary searches' early returns rely on. */
+    void narrow(T c, long long offset, long long* left, long long* right, bool left_side)
+    {
+        long long jlo = (*left + k - 1) / k, jhi = *right / k;
+        if (jlo > jhi) return; // no sample inside the range
+        if (left_side) {
+            // the first sample with a symbol >= c, or jhi + 1
+            long long lo = jlo, hi = jhi + 1;
+            while (lo < hi) {
+                sample_probes++;
+                long long mid = (lo + hi) / 2;
+                if (compare_sample(mid, offset, c) < 0) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo > jlo) *left = (lo - 1) * k + 1;
+            if (lo <= jhi) *right = lo * k;
+        } else {
+            // the last sample with a symbol <= c, or jlo - 1
+            long long lo = jlo - 1, hi = jhi;
+            while (lo < hi) {
+                sample_probes++;
+                long long mid = (lo + hi + 1) / 2;
+                if (compare_sample(mid, offset, c) > 0) hi = mid - 1;
+                else lo = mid;
+            }
+            if (lo >= jlo) *left = lo * k;
+            if (lo < jhi) *right = (lo + 1) * k - 1;
+        }
+    }
+};
+
+
+/* Timings and counters for --stats. The counters are always kept, because
+ * an increment is nothing next to the cache misses of the binary searches,
+ * but the parse and output times are only measured with --stats. */
+struct ParseStats {
+    PhaseTime dict_load;
+    PhaseTime sa_load;
+    PhaseTime parse;
+    PhaseTime output;
+    uint64_t search_probes;      // loop iterations in search_left/search_right
+    uint64_t extension_compares; // symbols compared in the single-suffix loop
+    uint64_t sa_block_reads;     // with --sa-on-disk, blocks read in the parse
+    uint64_t literals;           // symbols, so a run of literals counts as its length
+    uint64_t literal_runs;       // with --literal-runs, the tokens that are runs
+    uint64_t length_histogram[LENGTH_HISTOGRAM_BUCKETS];
+};
+
+
+/* The suffix array & dictionary file readers are hidden inside templated
+ * classes, because they both need to be held in memory while the parser runs,
+ * and so they need to be in the correct type -- an integer of some width,
+ * probably 32 for the SA and 8 in most cases for the dictionary, and C++'s
+ * type system isn't flexible enough (as far as I can tell) to allow for
+ * a generic integer of some length, determined solely by user input, without
+ * specifying all cases exactly, which is tedious, but this containerization
+ * helps.
+ * (The SA needs to actually be cast into integers, but the dictionary could
+ * remain as a series of bytes -- as long as we remain very careful with
+ * alignment -- might this be easier?)
+ *
+ * The classes that do the file reading are in filereader.h.
+ *
+ * T is the type of the symbols of our dictionary and input file, while
+ * S is the type of the symbols of the suffix array file.
+ */
+template <typename T, typename S> class Parser {
+    long long dict_size;
+    long long sa_size;
+
+    /* We need our own buffer, because if we're reading in symbols of e.g.
+     * four bytes width, we can't unget symbols straight back into the
+     * ifstream because ifstream doesn't guarantee more than one _byte_ of
+     * unget capability. It's a stack, next symbol last: find_token() only
+     * ever ungets one symbol, but find_token_sparse() reads further ahead. */
+    vector<T> ungotten;
+    ifstream source_file;
+    long long source_file_size_symbols;
+    int input_width; // bytes per input symbol: sizeof(T), unless use_alphabet()
+    long long read_counter;
+
+    bool print_progress_messages;
+    bool print_interval_message_printed; // not needed any more?
+    long long input_file_size; // used for calls to print_progress()
+    string input_file_name; // used for calls to print_progress()
+
+    /* With verify, every symbol getnext() reads goes here too, and emit()
+     * takes each token's symbols off the front, from verify_pos on. work()
+     * can find a batch of tokens before emitting any, so this may hold
+     * more than one token's worth. */
+    vector<T> verify_window;
+    size_t verify_pos;
+    uint64_t verified_symbols;
+
+    vector<T> literal_run; // with literal_runs, literals not yet written
+    uint64_t delta_prev_end; // for -f delta: see output_token()
+    uint64_t prev_phrase_end; // for --locality; literals don't move it
+    vector<T> lookahead; // find_token_sparse()'s input, from the token's start
+
+    /* From an .rlzdict bundle, if it has them: the stored symbol filter,
+     * and the k-mer table that kmer_search() looks the first kmer_k symbols
+     * of a token up in. kmer_k is 0 without one. */
+    FileReader<uint64_t>* filter_file;
+    FileReader<uint64_t>* kmer_file;
+    SymbolView<uint64_t> kmers;
+    long long kmer_k;
+
+    /* With --alphabet, getnext() reads input_width-byte symbols and
+     * returns their ranks, or alphabet->size() for symbols that aren't in
+     * it, which are then kept in escaped until emit() writes them out as
+     * literals, in the same order. Literals of ranks in the alphabet are
+     * turned back into symbols there too. NULL without --alphabet. */
+    const Alphabet* alphabet;
+    std::deque<uint64_t> escaped;
+
+public:
+    FileReader<T> dict_file; // these own the memory...
+    FileReader<S> sa_file;
+    SymbolView<T> dict;      // ...and all access goes through these
+    SymbolView<S> sa;
+    SymbolFilter<T> in_dict; // literals skip the SA search
+    SampledSA<T, S>* disk_sa; // with --sa-on-disk, searches go through this
+    ParseStats stats;
+    bool time_phases; // measure stats.parse and stats.output in work()
+    PerfCounters* perf; // if not NULL, counts the token finding in work()
+    MetricsFile* metrics; // if not NULL, updated for every token
+    bool verify; // --verify: check each token against the input it replaces
+    bool literal_runs; // --literal-runs: write literals in runs
+    int64_t locality; // --locality: see closest_occurrence(); 0 if off
+    int64_t sparse_k; // --sparse-sa: see find_token_sparse(); 0 if off
+    uint64_t input_checksum;  // with verify, FNV-1a of the input symbols...
+    uint64_t output_checksum; // ...and of the symbols the tokens decode to
+                              // (with an alphabet, the symbols, not ranks)
+
+    /* With a bundle, dict_file_name and sa_file_name are both the bundle,
+     * and the dictionary, suffix array and tables come out of it. */
+    Parser(string input_file_name, string dict_file_name, string sa_file_name,
+           bool verbose, int alloc_mode = ALLOC_HEAP,
+           const DictBundleHeader* bundle = NULL)
+        : dict_file(bundle_section(bundle, dict_file_name, RLZDICT_DICT), verbose, alloc_mode),
+          sa_file(bundle_section(bundle, sa_file_name, RLZDICT_SA), verbose,
+                  bundle == NULL ? alloc_mode | ALLOC_UNPACK_SA : alloc_mode),
+          dict(dict_file.view()), sa(sa_file.view())
+    {
+        dict_size = dict.size();
+        sa_size = sa.size();
+        stats = ParseStats();
+        stats.dict_load = dict_file.load_time;
+        stats.sa_load = sa_file.load_time;
+        filter_file = NULL;
+        kmer_file = NULL;
+        kmer_k = 0;
+        alphabet = NULL;
+        const DictBundleSection* section = NULL;
+        if (bundle != NULL && (section = dict_bundle_section(bundle, RLZDICT_FILTER)) != NULL) {
+            filter_file = new FileReader<uint64_t>(bundle_section(bundle, dict_file_name, RLZDICT_FILTER),
+                                                   false, ALLOC_MMAP);
+            if (!in_dict.load(filter_file->view(), dict_size)) {
+                cerr << "Error: the symbol filter in " << dict_file_name
+                     << " doesn't fit its dictionary\n";
+                exit(EXIT_INVALID_INPUT);
+            }
+        } else {
+            in_dict.build(dict);
+        }
+        if (bundle != NULL && (section = dict_bundle_section(bundle, RLZDICT_KMERS)) != NULL
+                && dict_size > 0) {
+            kmer_file = new FileReader<uint64_t>(bundle_section(bundle, dict_file_name, RLZDICT_KMERS),
+                                                 false, ALLOC_MMAP);
+            kmers = kmer_file->view();
+            if (section->param * sizeof(T) * 8 != RLZDICT_KMER_BITS
+                    || kmers.size() != (1LL << RLZDICT_KMER_BITS) + 1
+                    || kmers[kmers.size() - 1] != (uint64_t) sa_size) {
+                cerr << "Error: the k-mer table in " << dict_file_name
+                     << " doesn't fit its suffix array\n";
+                exit(EXIT_INVALID_INPUT);
+            }
+            kmer_k = section->param;
+        }
+        time_phases = false;
+        perf = NULL;
+        metrics = NULL;
+        disk_sa = NULL;
+        verify = false;
+        literal_runs = false;
+        delta_prev_end = 0;
+        prev_phrase_end = 0;
+        locality = 0;
+        sparse_k = 0;
+        input_checksum = FNV_OFFSET_BASIS;
+        output_checksum = FNV_OFFSET_BASIS;
+        verify_pos = 0;
+        verified_symbols = 0;
+
+        source_file = ifstream(input_file_name, ifstream::binary);
+        if (!source_file) error_die("Error: cannot open input file " + input_file_name);
+        input_file_size = file_size(&source_file);
+        set_input_width(sizeof(T));
+        read_counter = 0;
+        //print_interval_message_printed = false;
+        print_progress_messages = verbose;
+        this->input_file_name = input_file_name;
+    }
+
+    ~Parser()
+    {
+        delete filter_file;
+        delete kmer_file;
+    }
+
+    /* --alphabet: the dictionary is ranks in alphabet, and the input is
+     * width-byte symbols. Call before work(). */
+    void use_alphabet(const Alphabet* alphabet, int width)
+    {
+        this->alphabet = alphabet;
+        set_input_width(width);
+    }
+
+private:
+    void set_input_width(int width)
+    {
+        input_width = width;
+        source_file_size_symbols = input_file_size / width;
+        if (source_file_size_symbols * width != input_file_size) {
+            cerr << "Warning: input file size is indivisible by " << width << "; output will ignore extra bytes.\n";
+        }
+    }
+
+public:
+    long long dict_size_bytes()
+    {
+        return dict.size() * sizeof(T);
+    }
+
+    long long input_size_bytes()
+    {
+        return input_file_size;
+    }
+
+    // sa[i], from wherever the suffix array is.
+    S sa_at(long long i)
+    {
+        return disk_sa != NULL ? (*disk_sa)[i] : sa[i];
+    }
+
+    /* Token finder: using the dictionary and the suffix array, finds the
+     * longest occurrence of a prefix of the source text in the dictionary.
+     *
+     * IF A SYMBOL ISN'T IN THE DICTIONARY:
+     * outputs the symbol itself for the position and 0 for the length. */
+    RLZToken next_token()
+    {
+        RLZToken token = sparse_k > 0 ? find_token_sparse() : find_token();
+        if (token.length > 0)
+            prev_phrase_end = token.start_pos + token.length;
+        return token;
+    }
+
+    /* --locality: when the SA range [lo, hi] of suffixes all match as far
+     * as the phrase goes, any of them would do, and sa[lo] is as good as
+     * random. Instead take the one that starts closest to where the
+     * previous phrase ended, so that decompression reads the dictionary
+     * in fewer, nearer places (and -f delta has smaller numbers to write).
+     * Only the first `locality` suffixes of the range are looked at. */
+    S closest_occurrence(int64_t lo, int64_t hi)
+    {
+        S best = sa_at(lo);
+        if (locality <= 1) return best;
+        if (hi - lo >= locality) hi = lo + locality - 1;
+        uint64_t best_dist = best > prev_phrase_end ? best - prev_phrase_end
+                                                    : prev_phrase_end - best;
+        for (int64_t i = lo + 1; i <= hi && best_dist > 0; i++) {
+            S here = sa_at(i);
+            uint64_t dist = here > prev_phrase_end ? here - prev_phrase_end
+                                                   : prev_phrase_end - here;
+            if (dist < best_dist) {
+                best = here;
+                best_dist = dist;
+            }
+        }
+        return best;
+    }
+
+private:
+    /* With a bundle's k-mer table, the SA range of the suffixes that start
+     * with the first offset + 1 symbols of the token (first, and c if
+     * offset is 1) is looked up instead of binary searched for, while
+     * offset < kmer_k. Returns the left end of the range and sets *right,
+     * like search_left() and search_right() together would; or returns -1
+     * and leaves *right alone if there are no such suffixes. */
+    int64_t kmer_search(T first, T c, long long offset, int64_t* right)
+    {
+        int bits = RLZDICT_KMER_BITS / kmer_k; // per symbol
+        uint64_t prefix = offset == 0 ? (uint64_t) c : (uint64_t) first << bits | (uint64_t) c;
+        int shift = (kmer_k - 1 - offset) * bits;
+        uint64_t key = prefix << shift;
+        int64_t left = kmers[key];
+        int64_t r = (int64_t) kmers[(prefix + 1) << shift] - 1;
+        /* The dictionary's last suffix is one symbol long, and counts as
+         * if followed by a 0, so it's the first one under that key; but
+         * it doesn't match a second symbol. */
+        if (offset == 1 && key == (uint64_t) dict[dict_size - 1] << bits)
+            left++;
+        if (left > r) return -1;
+        *right = r;
+        return left;
+    }
+
+    RLZToken find_token()
+    {
+        RLZToken token;
+        token.start_pos = ULLONG_MAX;
+        token.length = -1LL;
+
+        // Storing the best partial match so far.
+        // Position is stored unsigned because of literals.
+        uint64_t best_pos = 0LL;
+        int64_t best_len = 0LL;
+        bool matching_suffix_found = false;
+
+        // These bound the SA search range, and are indices into the SA.
+        int64_t leftmost = 0, rightmost = sa_size - 1;
+
+        /* This has a twofold meaning:
+         * it's the length of the substring we've encoded so far, i.e.
+         * the number of symbols we've read from the file while creating
+         * the next token (minus one), and it's also the number of symbols
+         * we need to skip over when searching for strings in the suffix
+         * list, implicitly constructed from the suffix array. */
+        long long offset = 0;
+        T c = this->getnext();
+        T first = c; // for kmer_search()
+
+        while (read_counter <= source_file_size_symbols) {
+
+            if (this->end_of_input()) {
+                // Output the special end sentinel
+                return end_sentinel;
+            }
+
+            /* Most literals are caught here: the symbol that would start
+             * the token isn't anywhere in the dictionary. */
+            if (offset == 0 && !in_dict.may_contain(c)) {
+                token.start_pos = (uint64_t) c;
+                token.length = 0;
+                return token;
+            }
+
+            if (offset < kmer_k)
+                leftmost = kmer_search(first, c, offset, &rightmost);
+            else
+                leftmost = search_left(c, offset, leftmost, rightmost);
+
+            /* A very common case: either there is no suffix matching the
+             * current character because the character doesn't exist in the
+             * dictionary (in case we return a literal token),
+             * or we were leftward searching for a longer suffix than the
+             * longest one we already have, but there are none.
+             *
+             * Example: the current suffix is CDEFXYZ... and our offset is 4
+             * so we're comparing suffixes against character 'X'. The work
+             * we've done so far has given us a range of suffixes that all
+             * start with "CDEF"; the matching dictionary suffixes could be,
+             * for example, "CDEFA...", "CDEFF...", "CDEFG...", "CDEFZ".
+             * None of these offset=4 characters (A, F, G, Z) match X, so the
+             * leftmost returned by search_left will be negative, while
+             * best_pos will point to one of those suffixes (prob. CDEFA...)
+             * and best_len will be 4.
+             *
+             * Keep in mind that leftmost and rightmost are boundaries for
+             * a range of possible suffixes, and each time we run this loop
+             * we're moving leftmost to the right and rightmost to the left,
+             * and so if leftmost is < 0 that indicates that "I simply cannot
+             * give you any bounds for this substring you've given me,
+             * because your substring doesn't start any suffixes".
+             */
+            if (leftmost < 0) {
+                if (matching_suffix_found) {
+                    /* We already have a partial suffix we can return, so push
+                     * the extra unmatched character we already read back so
+                     * that the next next_token call can start with it. */
+                    token.start_pos = closest_occurrence(best_pos, rightmost);
+                    token.length = !matching_suffix_found ? 0 : best_len;
+                    this->unget(c);
+                } else {
+                    /* The symbol we have doesn't occur in the dictionary at
+                     * all (but in_dict didn't rule it out), so encode a
+                     * literal and return it. */
+                    token.start_pos = (uint64_t) c;
+                    token.length = 0;
+                }
+                return token;
+            }
+
+            auto old_rightmost = rightmost; // only needed for a debug message
+            if (offset >= kmer_k)
+                rightmost = search_right(c, offset, leftmost, rightmost);
+
+            /* Like the leftward search case, we were looking to move the right
+             * boundary of our range of suffixes leftward, but this isn't
+             * possible for our current substring: there's no suffix for which
+             * which its offset'th character equals c.
+             * However, if the input data is sane (= the suffix array describes
+             * an actual, valid, sorted suffix array; this can mess up if
+             * widths get confused (an SA calculated for 8-bit data while input
+             * input is 32-bit, for example)) then rightmost should never be
+             * negative.
+             * To illustrate why, let's use the same example data from before:
+             * offset = 4, the current suffix of input we're looking at is
+             * CDEFXYZ..., and so far we've found four suffixes matching the
+             * first four characters:
+             *
+             *            leftmost|              |rightmost
+             * i:     ...  14  15 |16  17  18  19| 20  21  22  23 ...
+             * SA[i]: ...  93  31 |94  32  73  25| 95  33  74  26 ... offset:
+             * Dict[SA]:   C   C  |C   C   C   C | D   D   D   D  ---- 0
+             *             C   C  |D   D   D   D | E   E   E   E  ---- 1
+             *             D   D  |E   E   E   E | F   F   F   F  ---- 2
+             *             E   E  |F   F   F   F | A   F   G   Z  ---- 3
+             *             F   F  |A   F   G   Z | $   .   .   .  ---- 4
+             *             A   Z  |$   .   .   . |     .   .   .  ---- 5
+             *             $   .  |    .   .   . |     .   .   .  ---- 6
+             * At the start of this iteration of the while loop, leftmost has
+             * been set to 16 (matching SA[16]=94, matching "CDEFA...") and
+             * rightmost has been set to 19 (matching SA[19]=25, matching
+             * "CDEFZ...").
+             *
+             * The current character is 'X', and it doesn't occur at offset 4
+             * in the range of suffixes we're restricted to. search_left works
+             * by starting with L = leftmost, then moving L in a binary search
+             * fashion between leftmost and rightmost, until it either finds
+             * the leftmost L where character Dict[SA[L]+offset] == 'X', or a
+             * negative value if no such suffix exists, meaning there's no
+             * suffix in the range with the offset'th = 4th character = 'X'.
+             * In that case this function is never run, because we've already
+             * returned a token in the if above.
+             *
+             * Let's change the suffix a bit: the suffix will be CDEFGHI...,
+             * and offset will still be 4. In this case search_left will return
+             * a new leftmost = 18, the if block will not be run, and we'll
+             * head onto the search for a rightmost character. It works much
+             * the same way: it starts with R = rightmost and binary searches
+             * leftward, with leftmost as a hard bound.
+             * **Assuming the suffix array is correct this should never fail**:
+             * in the worst case there is only one suffix (SA[18]) that matches
+             * the current character, and so the new rightmost will be 18.
+             * If this function returns a not-found, it means that the binary
+             * search in search_right failed. The binary search cannot fail,
+             * unless the suffixes aren't ordered: if suffix SA[19] was instead
+             * "CDEFA..." a failure would be understandable, because the search
+             * looks at the character 'A' and determines, correctly, that
+             * 'G' > 'A' and therefore index of 'G' > 19.
+             *
+             * How can this happen? It can happen easily with mismatched
+             * widths: if input data is 32-bit, then a suffix array calculated
+             * assuming that the input is 8-bit will produce out-of-order
+             * suffixes, unless careful pre- and postprocessing is done to
+             * produce a still-valid suffix array.
+             * (Preprocessing is ensuring that the input data is big-endian,
+             * and postprocessing removes all suffixes that don't point to a
+             * suffix starting at a 32-bit boundary & dividing the rest by 4.)
+             * It can also happen if this program has a bug, like a wrong kind
+             * of type, processing 64-bit data as 32-bit and losing half of
+             * each word.
+             */
+            if (rightmost < 0) {
+                cerr << "Error: failed binary search. Check your flags and your suffix array input;\nmaybe you forgot a --width flag, or skipped some suffix array processing?\nDebug: search_right(c=" << std::hex << std::showbase << (uint64_t) c << " offset=" << offset << " leftmost=" << leftmost << " rightmost=" << old_rightmost << ") retval=" << (int64_t) rightmost << " match_found=" << matching_suffix_found << " best_pos=" << best_pos << " best_len=" << best_len << std::dec << "\n";
+                exit(EXIT_BUG);
+            } else {
+                /* Bounds were successfully shrunk, so update our best known
+                 * partial suffix and length.
+                 * length + 1 because strings are zero-indexed. */
+                best_len = offset + 1;
+                best_pos = leftmost;
+                matching_suffix_found = true;
+            }
+
+            /* We're at the one suffix that matches the substring
+             * we have so far. Keep looking at how far we can take it. */
+            if (leftmost == rightmost) {
+                //cerr << "leftmost == rightmost\n"; /* to be deleted */
+                // Get the start of the one suffix...
+                S token_start_pos = sa_at(leftmost);
+                while (read_counter <= source_file_size_symbols) {
+                    /* The suffix, and the dictionary, may end before the
+                     * input matches it, which works like a mismatch. */
+                    if ((uint64_t) token_start_pos + offset >= unsign(dict_size)) {
+                        this->unget(c);
+                        token.start_pos = token_start_pos;
+                        token.length = offset;
+                        return token;
+                    }
+                    // ...and get the next symbol along it.
+                    T dict_sym_here = dict[token_start_pos + offset];
+                    stats.extension_compares++;
+                    if (c != dict_sym_here) {
+                        /* A mismatch: we now know how long the suffix is. */
+                        this->unget(c);
+                        token.start_pos = token_start_pos;
+                        token.length = offset;
+                        return token;
+                    }
+                    c = this->getnext();
+                    offset++;
+                }
+                /* The file ends here, and we know that the suffix we looked
+                 * at is good up to the very last symbol of the file. We know
+                 * this, because if there was a mismatch, even at the very
+                 * last symbol, the 'if (c != dict_sym_here)' block would be
+                 * run. The offset is just right, also: normally, we'd need
+                 * to decrement it (because ->getnext() got an EOF and so
+                 * 'offset' would point to a character past the end of the
+                 * suffix), but we also need to increment it because that's
+                 * how the data format works (strings are zero-indexed but
+                 * we store their length), so it cancels out.
+                 * next_token() will be run one more time, in order to return
+                 * the sentinel token that marks the end of input. */
+                token.start_pos = sa_at(leftmost);
+                token.length = offset;
+                return token;
+            }
+
+            offset++;
+            c = this->getnext();
+            /* It's not obvious why this check is required here: wouldn't this
+             * case have been handled in the leftmost==rightmost block, or
+             * wouldn't it suffice to leave this for the next iteration of
+             * the loop? Not necessarily: leftmost==rightmost only runs when
+             * there's only one matching suffix, and if we do nothing here then
+             * offset++ will cause the next iteration to be skipped and we'll
+             * run into the (true) source_file.eof() below, with the end
+             * sentinel returned. There's also always a good token for us to
+             * return here: literals (no suffix match) would've happened way
+             * back in the search_left check. */
+            if (this->end_of_input()) {
+                token.start_pos = closest_occurrence(leftmost, rightmost);
+                token.length = offset; // no need to increment again
+                return token;
+            }
+        }
+        /* Pondering:
+         * Being here means: we ->getnext()'ed a character, and that was the
+         * _last_ character, so the 'read_counter < source_file_size_symbols'
+         * condition I used to have fails, and we have to do a final round of
+         * string comparison.
+         * However, we only need to do a very partial comparison:
+         * the 'leftmost == rightmost' conditional takes care of cases where
+         * there's only one suffix that matches the end of the file, but
+         * here we're in a situation where there is more than one matching
+         * suffix -- however, matching to all but the last character,
+         * so we would need to check the offset'th character of the remaining
+         * suffixes.
+         * Changing the < to <= took care of that, but this code still runs,
+         * on the final iteration that's supposed to return the end sentinel.
+         * Return it, but also verify that the file is actually finished.
+         */
+        if (this->end_of_input()) {
+            // Natural end of parsing.
+            return end_sentinel;
+        } else {
+            cerr << "Error (bug): outside token-finding loop\n";
+            cerr << "offset " << std::dec << offset
+                 << ", read_counter " << read_counter
+                 << ", source_file_size_symbols " << source_file_size_symbols
+                 << ", left " << leftmost << ", right " << rightmost
+                 << ", char=" << c
+                 << ", eof=" << (source_file.eof() ? "yes" : "no") << endl;
+            exit(EXIT_BUG);
+        }
+    }
+
+    /* --sparse-sa: the suffix array only has the suffixes starting at every
+     * sparse_k'th dictionary position, so a phrase can't be found by
+     * searching for the input from where the token starts. But any
+     * occurrence at least sparse_k symbols long contains a sampled position,
+     * so instead, for every anchor j < sparse_k, search for the input from
+     * j symbols on, and see if one of the suffixes found is also preceded
+     * in the dictionary by the j symbols of input before the anchor. The
+     * longest phrase over all anchors wins. Shorter phrases may be missed,
+     * so tokens come out a bit shorter than with the full suffix array.
+     * The suffixes tried for each anchor are those matching the most
+     * symbols first, up to SPARSE_SA_CANDIDATES of them. */
+    RLZToken find_token_sparse()
+    {
+        lookahead.clear();
+        if (!read_ahead(1)) return end_sentinel;
+        RLZToken token;
+        token.start_pos = (uint64_t) lookahead[0];
+        token.length = 0;
+        uint64_t best_pos = 0, best_len = 0;
+        // SA ranges matching 1, 2, ... symbols from the anchor on
+        struct Level { long long left, right, length; };
+        vector<Level> levels;
+
+        for (long long j = 0; j < sparse_k && read_ahead(j + 1); j++) {
+            if (!in_dict.may_contain(lookahead[j])) continue;
+            levels.clear();
+            long long left = 0, right = sa_size - 1, offset = 0;
+            while (read_ahead(j + offset + 1)) {
+                T c = lookahead[j + offset];
+                left = search_left(c, offset, left, right);
+                if (left < 0) break;
+                right = search_right(c, offset, left, right);
+                offset++;
+                levels.push_back({ left, right, offset });
+                if (left == right) {
+                    // One suffix left: follow it as far as it goes.
+                    S q = sa_at(left);
+                    while ((uint64_t) q + offset < unsign(dict_size)
+                           && read_ahead(j + offset + 1)
+                           && dict[q + offset] == lookahead[j + offset]) {
+                        stats.extension_compares++;
+                        offset++;
+                    }
+                    levels.back().length = offset;
+                    break;
+                }
+            }
+            // Longest first; each level's range holds the next one's.
+            int checks = 0;
+            bool found = false;
+            for (long long m = (long long) levels.size() - 1;
+                 m >= 0 && !found && checks < SPARSE_SA_CANDIDATES; m--) {
+                if ((uint64_t) (j + levels[m].length) <= best_len) break;
+                for (long long i = levels[m].left; i <= levels[m].right
+                     && checks < SPARSE_SA_CANDIDATES; i++) {
+                    if (m + 1 < (long long) levels.size()
+                        && i >= levels[m + 1].left && i <= levels[m + 1].right)
+                        continue; // already tried
+                    checks++;
+                    S q = sa_at(i);
+                    if ((long long) q < j) continue;
+                    long long t = 0;
+                    while (t < j && dict[q - j + t] == lookahead[t]) t++;
+                    if (t == j) {
+                        best_pos = q - j;
+                        best_len = j + levels[m].length;
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (best_len > 0) {
+            token.start_pos = best_pos;
+            token.length = best_len;
+        }
+        // Put back what the token doesn't cover, for the next one.
+        size_t used = best_len > 0 ? best_len : 1;
+        for (size_t i = lookahead.size(); i > used; i--)
+            unget(lookahead[i - 1]);
+        return token;
+    }
+
+    // Reads input into lookahead until it has n symbols; false if it ends first.
+    bool read_ahead(size_t n)
+    {
+        while (lookahead.size() < n) {
+            if (end_of_input()) return false;
+            bool from_file = ungotten.empty();
+            T c = getnext();
+            if (from_file && source_file.gcount() != input_width) {
+                read_counter--; // not a symbol after all
+                return false;
+            }
+            lookahead.push_back(c);
+        }
+        return true;
+    }
+
+public:
+    void work(std::ostream* outfile, int output_mode, uint64_t* longest_token,
+              uint64_t* num_tokens, uint64_t* bytes_input,
+              uint64_t* bytes_output)
+    {
+        if (print_progress_messages) cerr << "Starting parsing...\n";
+        uint64_t keep_going = 1;
+        if (!time_phases) {
+            while (keep_going > 0) {
+                RLZToken token = this->next_token();
+                keep_going = emit(token, outfile, output_mode, longest_token,
+                                  num_tokens, bytes_input, bytes_output);
+            }
+            return;
+        }
+
+        vector<RLZToken> batch;
+        batch.reserve(STATS_BATCH_SIZE);
+        if (perf != NULL) perf->start();
+        while (keep_going > 0) {
+            PhaseTime parse_start = phase_time_now();
+            batch.clear();
+            do {
+                batch.push_back(this->next_token());
+            } while (batch.size() < STATS_BATCH_SIZE
+                     && !is_end_sentinel(&batch.back()));
+            if (perf != NULL) perf->pause();
+            PhaseTime output_start = phase_time_now();
+            for (RLZToken token : batch)
+                keep_going = emit(token, outfile, output_mode, longest_token,
+                                  num_tokens, bytes_input, bytes_output);
+            if (perf != NULL) perf->resume();
+            PhaseTime parse_time = phase_time_since(parse_start);
+            PhaseTime output_time = phase_time_since(output_start);
+            stats.output.wall += output_time.wall;
+            stats.output.cpu += output_time.cpu;
+            stats.parse.wall += parse_time.wall - output_time.wall;
+            stats.parse.cpu += parse_time.cpu - output_time.cpu;
+        }
+        if (perf != NULL) perf->stop();
+    }
+
+
+private:
+    // Writes out one token and does work()'s bookkeeping for it;
+    // returns output_token()'s return value.
+    uint64_t emit(RLZToken token, std::ostream* outfile, int output_mode,
+                  uint64_t* longest_token, uint64_t* num_tokens,
+                  uint64_t* bytes_input, uint64_t* bytes_output)
+    {
+        if (verify) verify_token(token, output_mode, *num_tokens);
+        if (alphabet != NULL && token.length == 0 && !is_end_sentinel(&token)) {
+            if (token.start_pos < alphabet->size()) {
+                token.start_pos = alphabet->symbol(token.start_pos);
+            } else {
+                token.start_pos = escaped.front();
+                escaped.pop_front();
+            }
+        }
+        if (verify && alphabet != NULL && !is_end_sentinel(&token))
+            checksum_alphabet_output(token);
+        uint64_t keep_going;
+        if (literal_runs && token.length == 0) {
+            literal_run.push_back((T) token.start_pos);
+            if (literal_run.size() == LITERAL_RUN_MAX)
+                flush_literal_run(outfile, output_mode, num_tokens, bytes_output);
+            keep_going = 1;
+        } else {
+            // also before the end sentinel, which flushes the stream
+            if (!literal_run.empty())
+                flush_literal_run(outfile, output_mode, num_tokens, bytes_output);
+            keep_going = output_token(token, outfile, output_mode, bytes_output,
+                                      &delta_prev_end);
+            (*num_tokens)++;
+        }
+        if (keep_going > *longest_token)
+            *longest_token = keep_going;
+        if (keep_going > 0) {
+            *bytes_input += token.length == 0
+                            ? input_width
+                            : token.length * input_width;
+            if (token.length == 0) stats.literals++;
+            stats.length_histogram[length_histogram_bucket(token.length)]++;
+        }
+        if (print_progress_messages)
+            print_progress(input_file_name, *bytes_input, input_file_size,
+                           keep_going == 0); // force printout at 100%
+        if (metrics != NULL)
+            metrics->update(*bytes_input, *bytes_output, *num_tokens - (keep_going == 0),
+                            keep_going == 0);
+        return keep_going;
+    }
+
+    // Writes out the buffered literals as one token.
+    void flush_literal_run(std::ostream* outfile, int output_mode,
+                           uint64_t* num_tokens, uint64_t* bytes_output)
+    {
+        output_literal_run(literal_run, outfile, output_mode, bytes_output);
+        literal_run.clear();
+        stats.literal_runs++;
+        (*num_tokens)++;
+    }
+
+    /* --verify: checks that the token decodes to exactly the symbols that
+     * were read to make it, and that it fits in the output format, before
+     * it's written out; exits on the first mismatch. At the end sentinel,
+     * also checks that every input symbol went into some token. */
+    void verify_token(RLZToken token, int output_mode, uint64_t token_index)
+    {
+        if (is_end_sentinel(&token)) {
+            if (verify_pos != verify_window.size()
+                || verified_symbols != unsign(source_file_size_symbols)) {
+                cerr << "Error: --verify: the tokens cover " << verified_symbols
+                     << " of " << source_file_size_symbols << " input symbols\n";
+                exit(EXIT_BUG);
+            }
+            if (input_checksum != output_checksum) {
+                cerr << "Error: --verify: the tokens decode to different symbols"
+                        " than the input has\n";
+                exit(EXIT_BUG);
+            }
+            return;
+        }
+        uint64_t length = token.length == 0 ? 1 : token.length;
+        string problem = "";
+        if (verify_window.size() - verify_pos < length) {
+            problem = "is longer than the input it was made from";
+        } else if (output_mode == FMT_32X2
+                   && ((token.start_pos > UINT32_MAX && !(literal_runs && token.length == 0))
+                       || unsign(token.length) > UINT32_MAX)) {
+            problem = "doesn't fit in 32x2 output; use -f 64x2 or vbyte";
+        } else if (token.length == 0) {
+            T sym = verify_window[verify_pos];
+            if (token.start_pos != (uint64_t) sym)
+                problem = "is a literal for the wrong symbol";
+            if (alphabet == NULL) {
+                input_checksum = fnv1a(input_checksum, sym);
+                output_checksum = fnv1a(output_checksum, (T) token.start_pos);
+            }
+        } else if (token.start_pos + length > unsign(dict_size)) {
+            problem = "runs past the end of the dictionary";
+        } else {
+            for (uint64_t i = 0; i < length; i++) {
+                T in_sym = verify_window[verify_pos + i];
+                T dict_sym = dict[token.start_pos + i];
+                if (alphabet == NULL) {
+                    input_checksum = fnv1a(input_checksum, in_sym);
+                    output_checksum = fnv1a(output_checksum, dict_sym);
+                }
+                if (in_sym != dict_sym) {
+                    problem = "copies different symbols than the input has, at +"
+                              + std::to_string(i);
+                    break;
+                }
+            }
+        }
+        if (problem.length() > 0) {
+            cerr << "Error: --verify: token " << token_index << " (" << token.start_pos
+                 << ", " << token.length << "), for input symbol " << verified_symbols
+                 << " on, " << problem << "\n";
+            exit(EXIT_BUG);
+        }
+        verified_symbols += length;
+        verify_pos += length;
+        if (verify_pos == verify_window.size()) {
+            verify_window.clear();
+            verify_pos = 0;
+        }
+    }
+
+    static uint64_t fnv1a(uint64_t hash, T sym)
+    {
+        for (size_t i = 0; i < sizeof(T); i++) {
+            hash ^= (sym >> (8 * i)) & 0xFF;
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    // Same, for an input symbol of input_width bytes.
+    uint64_t fnv1a_input(uint64_t hash, uint64_t sym)
+    {
+        for (int i = 0; i < input_width; i++) {
+            hash ^= (sym >> (8 * i)) & 0xFF;
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    /* --verify with an alphabet: verify_token() checks the ranks against
+     * the dictionary, but the checksums are of the symbols themselves, so
+     * the output side is summed here, after emit() has turned a literal's
+     * rank (or escape) back into its symbol. read_rank() sums the input. */
+    void checksum_alphabet_output(RLZToken token)
+    {
+        if (token.length == 0) {
+            output_checksum = fnv1a_input(output_checksum, token.start_pos);
+            return;
+        }
+        for (int64_t i = 0; i < token.length; i++)
+            output_checksum = fnv1a_input(output_checksum,
+                                          alphabet->symbol(dict[token.start_pos + i]));
+    }
+
+    T getnext()
+    {
+        if (!ungotten.empty()) {
+            T sym = ungotten.back();
+            ungotten.pop_back();
+            read_counter++;
+            if (verify) verify_window.push_back(sym);
+            return sym;
+        }
+        T buf[1];
+        buf[0] = 0;
+        if (alphabet != NULL)
+            buf[0] = read_rank();
+        else
+            source_file.read(reinterpret_cast<char *>(buf), sizeof(T));
+        if (verify && source_file.gcount() == input_width)
+            verify_window.push_back(buf[0]);
+        /* In cases where T is N>1 bytes wide and the input isn't a multiple
+         * of N, the buffer will be filled with the leftover bytes and both
+         * eofbit and failbit are set.
+         * We don't check for that here -- there are only a couple of places
+         * where ->getnext() is called, and in all of those but one there's
+         * a natural eof check in the next iteration of the loop. */
+        read_counter++;
+        return buf[0];
+    }
+
+    /* --alphabet: reads an input symbol, and returns its rank. The symbol's
+     * input_width bytes are the low bytes of sym, as it's little-endian. */
+    T read_rank()
+    {
+        uint64_t sym = 0;
+        source_file.read(reinterpret_cast<char *>(&sym), input_width);
+        if (source_file.gcount() != input_width) return 0;
+        if (verify) input_checksum = fnv1a_input(input_checksum, sym);
+        uint64_t rank = alphabet->rank(sym);
+        if (rank == alphabet->size()) escaped.push_back(sym);
+        return (T) rank;
+    }
+
+    bool end_of_input()
+    {
+        return source_file.eof() && ungotten.empty();
+    }
+
+    void unget(T sym)
+    {
+        if (verify) verify_window.pop_back();
+        ungotten.push_back(sym);
+        read_counter--;
+    }
+
+public:
+    // (Public only so that bench/microbench.cpp can time these on their own.)
+    /* The 'offset' parameter is an index to the string we're searching:
+     * if we're trying to tokenize the string "string", and we've already
+     * the first and last suffix in the SA that begin with 's', we'd set
+     * 'offset' to 1 and search for those suffixes that begin with "st";
+     * the suffixes that begin with "st" are entirely a subset of the
+     * suffixes that begin with "s", so they'll be in the range given by
+     * old_left_bound and right_bound, if they exist.
+     * With --sa-on-disk, disk_sa narrows the range down to one block first,
+     * and the search itself goes through it instead of the sa view. */
+    long long search_left(T text_symbol, int offset, long long old_left_bound, long long right_bound)
+    {
+        if (disk_sa == NULL)
+            return search_left_in(sa, text_symbol, offset, old_left_bound, right_bound);
+        disk_sa->narrow(text_symbol, offset, &old_left_bound, &right_bound, true);
+        return search_left_in(*disk_sa, text_symbol, offset, old_left_bound, right_bound);
+    }
+
+    long long search_right(T text_symbol, int offset, long long left_bound, long long old_right_bound)
+    {
+        if (disk_sa == NULL)
+            return search_right_in(sa, text_symbol, offset, left_bound, old_right_bound);
+        disk_sa->narrow(text_symbol, offset, &left_bound, &old_right_bound, false);
+        return search_right_in(*disk_sa, text_symbol, offset, left_bound, old_right_bound);
+    }
+
+private:
+    // The searches themselves; A is SymbolView<S> or SampledSA<T, S>.
+    template <typename A>
+    long long search_left_in(A& sa, T text_symbol, int offset, long long old_left_bound, long long right_bound)
+    {
+        long long left = old_left_bound, right = right_bound;
+        while (left <= right) { // safe cutoff condition?
+            stats.search_probes++;
+            long long mid = (left + right) / 2;
+            if (sa[mid] + offset >= unsign(dict.size())) {
+                // End of string: the dictionary, & thus the suffix, ends here.
+                // Traditionally the end-of-string "character" sorts lower
+                // than any symbol in the alphabet, so this is equivalent to
+                // the mid_symbol < text_symbol case below.
+                left = mid + 1;
+                continue;
+            }
+            T mid_symbol = dict[sa[mid] + offset];
+            if (mid_symbol < text_symbol) {
+                left = mid + 1;
+            } else if (mid_symbol > text_symbol) {
+                right = mid - 1;
+            } else {
+                if (mid == old_left_bound) {
+                    // At the leftmost occurrence of the key
+                    return mid;
+                }
+                if (sa[mid - 1] + offset >= unsign(dict.size())) {
+                    // The suffix sorted right before mid is at the end of the
+                    // dictionary, ending with the end-of-string symbol.
+                    // Implications: mid_minus_one != mid_symbol, therefore the
+                    // if-else below would take the else branch.
+                    return mid;
+                }
+                // This can't underflow, because of the previous if
+                T mid_minus_one = dict[sa[mid - 1] + offset];
+                if (mid_minus_one == mid_symbol) {
+                    right = mid - 1; // discard mid and everything to its right
+                } else {
+                    return mid; // leftmost occurrence of key found
+                }
+            }
+        }
+        return -(left + 1); // key not found
+    }
+
+    template <typename A>
+    long long search_right_in(A& sa, T text_symbol, int offset, long long left_bound, long long old_right_bound)
+    {
+        long long left = left_bound, right = old_right_bound;
+        while (left <= right) { // safe cutoff condition?
+            stats.search_probes++;
+            long long mid = (left + right) / 2;
+            if (sa[mid] + offset >= unsign(dict.size())) {
+                // End of dictionary, end of suffix, sorts lower than any symbol.
+                // No need to update right: this is a special case of the
+                // mid_symbol < text_symbol case.
+                left = mid + 1;
+                continue;
+            }
+            T mid_symbol = dict[sa[mid] + offset];
+            if (mid_symbol < text_symbol) {
+                left = mid + 1;
+            } else if (mid_symbol > text_symbol) {
+                right = mid - 1;
+            } else {
+                if (mid == old_right_bound) {
+                    // At the rightmost occurrence of the key
+                    return mid;
+                }
+                if (sa[mid + 1] + offset >= unsign(dict.size())) {
+                    // The suffix sorted right afer mid is at the end of the
+                    // dictionary, ending with the end-of-string symbol.
+                    // Implications: mid_plus_one != mid_symbol, therefore the
+                    // if-else below would take the else branch.
+                    return mid;
+                }
+                T mid_plus_one = dict[sa[mid + 1] + offset];
+                if (mid_plus_one == mid_symbol) {
+                    left = mid + 1; // discard mid and everything to its left
+                } else {
+                    return mid; // rightmost occurrence of key found
+                }
+            }
+        }
+        return -(right - 1); // key not found
+    }
+
+};
+
+#endif // include guard, RLZ_PARSE_H_INCLUDED
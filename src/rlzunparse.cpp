@@ -33,8 +33,16 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <queue>
+#include <cstdio>
 #include <cstdlib>
-#include "rlzcommon.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rlzunparse.h"
 
 #ifndef VERSION_STRING
 #define VERSION_STRING "0.9.1"
@@ -56,215 +64,444 @@ void print_help() {
             "Usage: rlzunparse [options] -d DICTIONARY -i INFILE -o OUTFILE\n"
             "Options:\n"
             "  -w, --width 8/16/32/64    Bit width of dictionary & output symbols, default=8\n"
-            "  -f, --input-fmt 32x2/64x2/ascii/vbyte\n"
+            "                            (or packed 24/40/48)\n"
+            "  -f, --input-fmt 32x2/64x2/ascii/vbyte/delta\n"
             "                            Different formats of RLZ files.\n"
             "                            32x2 and 64x2 are pairs of binary integers.\n"
             "                            ascii uses whitespace-separated decimal numbers.\n"
             "                            vbyte is an efficient little-endian byte encoding.\n"
+            "                            delta is vbyte with relative positions.\n"
             "  -a I, --from I    Start decompression at output symbol I.\n"
             "  -b J, --to J      Stop decompression at output symbol J.\n"
             "I and J are both inclusive, and start at 1. Leaving out one or the other causes\n"
             "decompression to start at I or stop at J; specifying 0 for either is equivalent\n"
             "to not specifying them at all.\n"
+            "  --literal-runs    The file was made with rlzparse --literal-runs.\n"
+            "  --index FILE      Use FILE, from rlzparse --index, to go straight to -a.\n"
+            "  --sparse          With -b, read only the parts of the dictionary the range uses.\n"
+            "  --external-memory MB  For dictionaries bigger than memory: read the dictionary\n"
+            "                    once from start to end, using about MB megabytes of memory.\n"
+            "  --alphabet FILE   The dictionary is ranks in FILE, made by rlztools.alphabet;\n"
+            "                    -w gives the output's width.\n"
+            "  --huge-pages      Back the dictionary with transparent huge pages.\n"
+            "  --hugetlb         Same, but from the preallocated hugetlbfs pool.\n"
+            "  --numa-interleave Spread the dictionary's pages over all NUMA nodes.\n"
+            "  --stats           Print timings and hardware counters at the end.\n"
+            "  --stats-json      Same, as JSON on stdout.\n"
+            "DICTIONARY can also be an .rlzdict bundle, which knows its width: leave out -w.\n"
             "Also accepted: --dictionary, --infile, --outfile instead of -d, -i, -o.\n"
             "(rlzunparse version " VERSION_STRING ", " DATE_STRING ")\n";
 }
 
 
-/* OutputWriter is our unparser class: it reads from an RLZInputReader,
- * then writes T-type items (uint8_t, 16_t, 32_t, 64_t).
- * It also does the arbitrary-decompression-position math, counting in
- * T-sized symbols, not in bytes.
- * It's used by initializing with dictionary and output file names
- * (which it will open as files), then calling unparse() with an
- * RLZInputReader parameter; unparse() will read input tokens and
- * call write_next() to do output. */
-template <typename T> class OutputWriter {
-private:
-    FileReader<T> dict;
-    long dict_size;
-    ofstream outfile;
-public:
-    OutputWriter(string dict_file_name, string output_file_name)
-        : dict(dict_file_name, false)
-    {
-        dict_size = dict.size();
-        outfile = ofstream(output_file_name, ofstream::binary | ofstream::trunc);
-        if (!outfile) {
-            cerr << "Error: cannot open output file '" << output_file_name << "'\n";
-            exit(1);
-        }
+// For --stats; see rlzparse.cpp.
+struct UnparseStats {
+    PhaseTime dict_load;
+    PhaseTime decode;
+    PerfCounters* perf; // counts the decode loop if not NULL
+};
+
+/* Runs an OutputWriter with T-wide symbols, returning what unparse() does.
+ * With an alphabet, the dictionary is D-wide ranks in it.
+ * (Direct initialization, like in rlzparse, because OutputWriter holds
+ * an ofstream.) */
+template <typename T, typename D = T>
+uint64_t run_unparser(FileSection dict_section, string output_file_name,
+                      int alloc_mode, bool quiet_mode,
+                      RLZInputReader* inputreader,
+                      long long start_pos, long long stop_pos,
+                      long long skipped_symbols, UnparseStats* stats,
+                      const Alphabet* alphabet = NULL)
+{
+    OutputWriter<T, D> ow(dict_section, output_file_name,
+                          quiet_mode ? alloc_mode | ALLOC_QUIET : alloc_mode, alphabet);
+    if (!quiet_mode && alloc_mode != ALLOC_HEAP)
+        cerr << "dictionary in memory: " << ow.dict_memory_report() << "\n";
+    if (alphabet != NULL && !alphabet->covers(ow.dictionary())) {
+        cerr << "Error: " << dict_section.file_name << " has symbols that aren't ranks in the "
+             << "--alphabet;\nwere they made together by rlztools.alphabet?\n";
+        exit(EXIT_INVALID_INPUT);
     }
+    stats->dict_load = ow.dict_load_time();
+    PhaseTime decode_start = phase_time_now();
+    if (stats->perf != NULL) stats->perf->start();
+    uint64_t x = ow.unparse(inputreader, start_pos, stop_pos, skipped_symbols);
+    if (stats->perf != NULL) stats->perf->stop();
+    stats->decode = phase_time_since(decode_start);
+    return x;
+}
 
-    long long write_next(RLZToken token, long long start = 0, long long stop = 0) {
-        long long pos = token.start_pos;
-        long long len = token.length;
-        char bytebuf[sizeof(T)];
-        T* outbuf = reinterpret_cast<T*>(bytebuf);
 
-        if (len == 0) {
-            // output a literal
-            outbuf[0] = (T) pos;
-            for (uint64_t i = 0; i < sizeof(T); i++) outfile.put(bytebuf[i]);
-            return 1L;
+// --alphabet: run_unparser() for a dictionary of dict_width_bits-bit ranks.
+template <typename T>
+uint64_t run_alphabet_unparser(int dict_width_bits, const Alphabet* alphabet,
+                               FileSection dict_section, string output_file_name,
+                               int alloc_mode, bool quiet_mode,
+                               RLZInputReader* inputreader,
+                               long long start_pos, long long stop_pos,
+                               long long skipped_symbols, UnparseStats* stats)
+{
+    switch (dict_width_bits) {
+        case 8:
+            return run_unparser<T, uint8_t>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                            inputreader, start_pos, stop_pos, skipped_symbols,
+                                            stats, alphabet);
+        case 16:
+            return run_unparser<T, uint16_t>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                             inputreader, start_pos, stop_pos, skipped_symbols,
+                                             stats, alphabet);
+        case 32:
+            return run_unparser<T, uint32_t>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                             inputreader, start_pos, stop_pos, skipped_symbols,
+                                             stats, alphabet);
+        default:
+            cerr << "Bug: unknown rank width " << dict_width_bits << "\n";
+            exit(EXIT_BUG);
+    }
+}
+
+
+/* --sparse: when only symbols start_pos..stop_pos (1-based, inclusive) of
+ * the output are wanted, reading in the whole dictionary is most of the
+ * work if it's big. Instead, go through the tokens covering the range
+ * first, noting which parts of the dictionary they copy, and then read only
+ * those parts. They're read in file order, with parts less than
+ * SPARSE_MERGE_GAP bytes apart read as one, and all of them are announced
+ * to the kernel with posix_fadvise() first so that it can fetch them at
+ * the same time. Returns what unparse() does; the reads count as
+ * dict_load in --stats and the rest as decode. */
+#define SPARSE_MERGE_GAP 4096
+
+template <typename T>
+uint64_t run_sparse(FileSection dict_section, string output_file_name,
+                    RLZInputReader* inputreader,
+                    long long start_pos, long long stop_pos,
+                    long long skipped_symbols, UnparseStats* stats)
+{
+    // A piece of output: count symbols from the dictionary at from, or
+    // from the literals vector at from.
+    struct Piece {
+        uint64_t from;
+        uint64_t count;
+        bool literal;
+        uint64_t buf_pos; // where the dictionary part ended up in buf
+    };
+    std::vector<Piece> pieces;
+    std::vector<T> literals, literal_run;
+    long long toks_read = 0;
+    PhaseTime decode_start = phase_time_now();
+    if (stats->perf != NULL) stats->perf->start();
+    long long output_pos = skipped_symbols; // symbols before the next token
+    if (start_pos <= 0) start_pos = 1;
+
+    while (inputreader->keep_going() && output_pos < stop_pos) {
+        RLZToken tok = inputreader->next_token();
+        if (is_end_sentinel(&tok)) break;
+        toks_read++;
+        long long len = tok.length == 0 ? 1 : tok.length;
+        bool run = tok.length == 0 && inputreader->literal_width > 0;
+        if (run) {
+            if (tok.start_pos == 0 || tok.start_pos > LITERAL_RUN_MAX) {
+                cerr << "Error: literal run of " << tok.start_pos
+                     << " symbols; is this file really --literal-runs?\n";
+                exit(EXIT_INVALID_INPUT);
+            }
+            len = tok.start_pos;
+            literal_run.resize(len);
+            inputreader->read_literals(literal_run.data(), len);
+        }
+        // The part of this token's symbols output_pos+1..output_pos+len
+        // that's in the range, as 0-based offsets into the token.
+        long long lo = std::max(start_pos - output_pos - 1, 0LL);
+        long long hi = std::min(stop_pos - output_pos, len);
+        output_pos += len;
+        if (lo >= hi) continue;
+        if (tok.length > 0) {
+            pieces.push_back({ tok.start_pos + lo, (uint64_t) (hi - lo), false, 0 });
         } else {
-            if (stop <= 0)
-                stop = len;
-            long token_end = pos + stop;
-            // off-by-one arithmetic check:
-            // dict size 8 = indices 0 (inclusive) to 8 (exclusive)
-            // 0  1  2  3  4  5  6  7  ! <- out of bounds
-            // token (6, 2) =>   1  2     ok. 6 + 2 = 8, 8 <= dict_size.
-            // token (7, 1) =>      1     ok, 7 + 1 = 8, 8 <= dict_size.
-            // token (7, 2) =>      1  2  not ok: 7 + 2 = 9, 9 > dict_size.
-            if (token_end > dict_size) {
-                cerr << "Warning: token (0x" << hex << pos << ", 0x" << len << ") exceeds dictionary length of " << dec << dict_size << ", truncating.\n";
-                token_end = dict_size;
+            pieces.push_back({ literals.size(), (uint64_t) (hi - lo), true, 0 });
+            if (run)
+                literals.insert(literals.end(), literal_run.begin() + lo, literal_run.begin() + hi);
+            else
+                literals.push_back((T) tok.start_pos);
+        }
+    }
+
+    PhaseTime fetch_start = phase_time_now();
+    string dict_file_name = dict_section.file_name;
+    int fd = open(dict_file_name.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        cerr << "Error: can't open dictionary file " << dict_file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    uint64_t dict_size = (dict_section.length >= 0 ? dict_section.length : st.st_size) / sizeof(T);
+
+    // Dictionary parts in file order, merged into ranges.
+    std::vector<size_t> order;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        if (pieces[i].literal) continue;
+        if (pieces[i].from + pieces[i].count > dict_size) {
+            cerr << "Warning: token reaching " << pieces[i].from + pieces[i].count
+                 << " exceeds dictionary length of " << dict_size << ", truncating.\n";
+            pieces[i].count = pieces[i].from < dict_size ? dict_size - pieces[i].from : 0;
+        }
+        order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return pieces[a].from < pieces[b].from;
+    });
+    struct Range { uint64_t from, to, buf_pos; };
+    std::vector<Range> ranges;
+    uint64_t buf_size = 0;
+    uint64_t gap = SPARSE_MERGE_GAP / sizeof(T);
+    for (size_t i : order) {
+        Piece& p = pieces[i];
+        if (ranges.empty() || p.from > ranges.back().to + gap) {
+            ranges.push_back({ p.from, p.from + p.count, buf_size });
+        } else if (p.from + p.count > ranges.back().to) {
+            ranges.back().to = p.from + p.count;
+        }
+        buf_size = ranges.back().buf_pos + (ranges.back().to - ranges.back().from);
+        p.buf_pos = ranges.back().buf_pos + (p.from - ranges.back().from);
+    }
+
+    for (Range& r : ranges)
+        posix_fadvise(fd, r.from * sizeof(T), (r.to - r.from) * sizeof(T), POSIX_FADV_WILLNEED);
+    std::vector<T> buf(buf_size);
+    for (Range& r : ranges) {
+        char* dest = reinterpret_cast<char*>(buf.data() + r.buf_pos);
+        uint64_t bytes = (r.to - r.from) * sizeof(T), done = 0;
+        while (done < bytes) {
+            ssize_t got = pread(fd, dest + done, bytes - done, dict_section.offset + r.from * sizeof(T) + done);
+            if (got <= 0) {
+                cerr << "Error: can't read dictionary file " << dict_file_name << "\n";
+                exit(EXIT_INVALID_INPUT);
             }
-            for (long x = pos + start; x < token_end; x++) {
-                outbuf[0] = dict[x];
-                for (size_t i = 0; i < sizeof(T); i++) outfile.put(bytebuf[i]);
+            done += got;
+        }
+    }
+    close(fd);
+    stats->dict_load = phase_time_since(fetch_start);
+
+    ofstream outfile(output_file_name, ofstream::binary | ofstream::trunc);
+    if (!outfile) {
+        cerr << "Error: cannot open output file '" << output_file_name << "'\n";
+        exit(1);
+    }
+    long long syms_written = 0;
+    for (Piece& p : pieces) {
+        const T* src = p.literal ? &literals[p.from] : &buf[p.buf_pos];
+        outfile.write(reinterpret_cast<const char*>(src), p.count * sizeof(T));
+        syms_written += p.count;
+    }
+    outfile.close();
+    if (stats->perf != NULL) stats->perf->stop();
+    stats->decode = phase_time_since(decode_start);
+    stats->decode.wall -= stats->dict_load.wall;
+    stats->decode.cpu -= stats->dict_load.cpu;
+    return (toks_read << 32) | syms_written;
+}
+
+
+/* --external-memory: for dictionaries bigger than memory. Copying phrases
+ * in token order reads the dictionary all over the place, which is fine
+ * in RAM but hopeless from disk. Instead:
+ * 1. read through the tokens once to find the output's length, and map
+ *    the output file in at that length;
+ * 2. read through them again, writing literals straight to the output
+ *    and collecting phrases as ExternalCopy records, which are sorted by
+ *    dictionary position and spilled next to the output file whenever
+ *    half of memory_budget bytes of them have piled up;
+ * 3. merge the spilled runs while reading the dictionary once from start
+ *    to end, in blocks of the other half of memory_budget bytes, copying
+ *    each phrase from its block to where it goes in the output.
+ * Returns what unparse() does; the last step counts as dict_load in
+ * --stats, and the rest as decode. */
+#define EXTERNAL_RUN_READ 4096 // records read at a time from a spilled run
+
+struct ExternalCopy {
+    uint64_t dict_pos;
+    uint64_t length;
+    uint64_t out_pos;
+};
+
+// One sorted run of ExternalCopy records, in memory or spilled to a file.
+class ExternalRun {
+    std::vector<ExternalCopy> buf;
+    size_t next;
+    ifstream file;
+public:
+    ExternalRun(std::vector<ExternalCopy>* records) : next(0) { buf.swap(*records); }
+    ExternalRun(string file_name) : next(0), file(file_name, ifstream::binary) {}
+
+    // The next record, or NULL once the run is done.
+    ExternalCopy* peek() {
+        if (next == buf.size() && file.is_open() && file) {
+            buf.resize(EXTERNAL_RUN_READ);
+            file.read(reinterpret_cast<char*>(buf.data()), EXTERNAL_RUN_READ * sizeof(ExternalCopy));
+            buf.resize(file.gcount() / sizeof(ExternalCopy));
+            next = 0;
+        }
+        return next < buf.size() ? &buf[next] : NULL;
+    }
+    void pop() { next++; }
+};
+
+template <typename T>
+uint64_t run_external(FileSection dict_section, string output_file_name,
+                      RLZInputReader* inputreader, uint64_t memory_budget,
+                      UnparseStats* stats)
+{
+    PhaseTime decode_start = phase_time_now();
+    if (stats->perf != NULL) stats->perf->start();
+    std::vector<T> literal_run;
+
+    // 1. The output's length.
+    uint64_t total = 0;
+    long long toks_read = 0;
+    while (inputreader->keep_going()) {
+        RLZToken tok = inputreader->next_token();
+        if (is_end_sentinel(&tok)) break;
+        toks_read++;
+        if (tok.length > 0) {
+            total += tok.length;
+        } else if (inputreader->literal_width > 0) {
+            if (tok.start_pos == 0 || tok.start_pos > LITERAL_RUN_MAX) {
+                cerr << "Error: literal run of " << tok.start_pos
+                     << " symbols; is this file really --literal-runs?\n";
+                exit(EXIT_INVALID_INPUT);
             }
-            return token.length;
+            literal_run.resize(tok.start_pos);
+            inputreader->read_literals(literal_run.data(), tok.start_pos);
+            total += tok.start_pos;
+        } else {
+            total++;
         }
     }
 
-    // returns two 32-bit values packed into one 64-bit int
-    uint64_t unparse(RLZInputReader* inputreader, long long start_pos, long long stop_pos) {
-        long long toks_read = 0;
-        long long syms_written = 0;
-        // 1-based index of the last symbol of the most recent token processed
-        long long output_pos = 0;
-        //cerr << "start " << start_pos << " stop " << stop_pos << "\n";
-        while (inputreader->keep_going()) {
-            RLZToken tok = inputreader->next_token();
-            if (is_end_sentinel(&tok))
-                break;
-            toks_read++;
-
-            if (start_pos == 0 && stop_pos == 0) {
-                syms_written += this->write_next(tok);
-            } else {
-                // Calculating what segment of the output text this token
-                // represents, and whether it's one we need to care about.
-                long long effective_token_length = tok.length == 0 ? 1 : tok.length;
-                // token_start_pos is the index of token's character 0
-                // (0-based indexing) in terms of the output text (1-based)
-                long long token_start_pos = output_pos + 1;
-                long long token_end_pos = output_pos + effective_token_length;
-                //cerr << "(pos="<< tok.start_pos << " len=" << tok.length << " sp=" << token_start_pos << " ep=" << token_end_pos << " outp=" << output_pos << ") ";
-
-                // Start at position I, continue until end.
-                if (start_pos > 0 && stop_pos == 0) {
-                    //cerr << "1 ";
-                    if (token_start_pos >= start_pos) { // this had output_pos >= start_pos, so if it breaks check that
-                        syms_written += this->write_next(tok);
-                    } else if (token_start_pos < start_pos && token_end_pos >= start_pos) {
-                        // "start at character 5", start_pos = 5
-                        // token has length = 4
-                        // before: offset = 2
-                        //         token_start_pos = 2 + 1 = 3
-                        //         token_end_pos = 2 + 4 = 6
-                        // 0 1 2 3 4 5 6 7 8 9
-                        //   a b b a b a a b c
-                        //   * *                already decoded part
-                        //       * * * *        token's phrase
-                        //       0 1 2 3        token-internal indices
-                        //           * *        part we want to keep, starting at 2
-                        // different case: we start at exactly the token's start
-                        // before: offset = 4, token_start_pos = 5, end_pos = 8
-                        // 0 1 2 3 4 5 6 7 8 9
-                        //   a b b a b a a b c
-                        //   * * * *            already decoded part
-                        //           * * * *    token's phrase
-                        //           0 1 2 3
-                        // the correct calculation is start_pos - token_start_pos
-
-                        // Converting both to token-internal indexing and 0-based indexing.
-                        long long start = start_pos - token_start_pos;
-                        long long stop = tok.length;
-                        syms_written += this->write_next(tok, start, stop);
-                    } else {
-                        //cerr << "skip ";
-                        // This token occurs before the bit to output starts.
-                        ;
-                    }
-                    output_pos = token_end_pos;
-                // Start at beginning, continue until position J.
-                } else if (start_pos == 0 && stop_pos > 0) {
-                    //cerr << "2 ";
-                    if (token_end_pos < stop_pos) {
-                        syms_written += this->write_next(tok);
-                    } else if (token_start_pos <= stop_pos && token_end_pos >= stop_pos) {
-                        // stop_pos = 6
-                        // token has length = 4, starting with offset = 3
-                        // token_start = 3+1=4, token_end = 3+4=7
-                        // 0 1 2 3 4 5 6 7 8 9
-                        //   a b b a b a a b c
-                        //   * * *              already written
-                        //         * * * *      token's text
-                        //         0 1 2 3      token's indices
-                        //         * * *        all we want to keep
-                        // write_next uses a < comparison, so
-                        // token_end - stop_pos = 1 is number of chars to skip
-                        // tok->length - token_end + stop_pos
-                        // tok->length + stop_pos - token_end stays positive
-                        long long start = 0;
-                        long long stop = tok.length + stop_pos - token_end_pos;
-                        syms_written += this->write_next(tok, start, stop);
-                    } else {
-                        //cerr << "skip\n";
-                        // This token occurs wholly after position J.
-                        break;
-                    }
-                    output_pos = token_end_pos;
-                // Start at position I, stop at position J.
-                // start_pos = 4, stop_pos = 6
-                // 0 1 2 3 4 5 6 7 8 9
-                //         * * * *      all we want to output
-                //   * *           * *  case 1: token entirely outside range
-                //           * *        case 2: token entirely inside range
-                //     * * * *          case 3: token overlaps start of range
-                //             * * * *  case 4: token overlaps end of range
-                //       * * * * * *    case 5: range entirely inside token
-                } else {
-                    //cerr << "3-";
-                    if (token_start_pos > stop_pos || token_end_pos < start_pos) {
-                        //cerr << "1 ";
-                        // case 1: token entirely outside range
-                        if (token_start_pos > stop_pos)
-                            break;
-                    } else if (token_start_pos >= start_pos && token_end_pos <= stop_pos) {
-                        //cerr << "2 ";
-                        // case 2: token entirely inside range
-                        syms_written += this->write_next(tok);
-                    } else if (token_start_pos <= start_pos && token_end_pos <= stop_pos) {
-                        //cerr << "3 ";
-                        // case 3: token overlaps start of range
-                        long long start = start_pos - token_start_pos;
-                        long long stop = tok.length;
-                        syms_written += this->write_next(tok, start, stop);
-                    } else if (token_start_pos >= start_pos && token_end_pos >= stop_pos) {
-                        //cerr << "4 ";
-                        // case 4: token overlaps end of range
-                        long long start = 0;
-                        long long stop = tok.length + stop_pos - token_end_pos;
-                        syms_written += this->write_next(tok, start, stop);
-                    } else {
-                        //cerr << "5 ";
-                        // case 5: token overlaps entire range
-                        long long start = start_pos - token_start_pos;
-                        long long stop = tok.length + stop_pos - token_end_pos;
-                        syms_written += this->write_next(tok, start, stop);
-                    }
-                    output_pos = token_end_pos;
-                }
-                //cerr << "\n";
+    int out_fd = open(output_file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (out_fd < 0 || ftruncate(out_fd, total * sizeof(T)) != 0) {
+        cerr << "Error: cannot open output file '" << output_file_name << "'\n";
+        exit(1);
+    }
+    T* out = NULL;
+    if (total > 0) {
+        void* p = mmap(NULL, total * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+        if (p == MAP_FAILED) {
+            cerr << "Error: can't map output file '" << output_file_name << "' into memory\n";
+            exit(1);
+        }
+        out = static_cast<T*>(p);
+    }
+
+    // 2. Literals, and sorted runs of phrases.
+    size_t run_records = std::max<uint64_t>(memory_budget / 2 / sizeof(ExternalCopy), 1);
+    std::vector<ExternalCopy> records;
+    std::vector<string> run_files;
+    std::vector<ExternalRun*> runs;
+    auto by_dict_pos = [](const ExternalCopy& a, const ExternalCopy& b) {
+        return a.dict_pos < b.dict_pos;
+    };
+    inputreader->seek(0, 0);
+    uint64_t out_pos = 0;
+    while (inputreader->keep_going() && out_pos < total) {
+        RLZToken tok = inputreader->next_token();
+        if (is_end_sentinel(&tok)) break;
+        if (tok.length > 0) {
+            records.push_back({ tok.start_pos, (uint64_t) tok.length, out_pos });
+            out_pos += tok.length;
+        } else if (inputreader->literal_width > 0) {
+            inputreader->read_literals(out + out_pos, tok.start_pos);
+            out_pos += tok.start_pos;
+        } else {
+            out[out_pos++] = (T) tok.start_pos;
+        }
+        if (records.size() == run_records) {
+            std::sort(records.begin(), records.end(), by_dict_pos);
+            string run_file_name = output_file_name + ".run" + std::to_string(run_files.size());
+            ofstream run_file(run_file_name, ofstream::binary | ofstream::trunc);
+            run_file.write(reinterpret_cast<const char*>(records.data()),
+                           records.size() * sizeof(ExternalCopy));
+            if (!run_file) {
+                cerr << "Error: can't write temporary file " << run_file_name << "\n";
+                exit(1);
             }
+            run_files.push_back(run_file_name);
+            records.clear();
         }
-        return (toks_read << 32) | syms_written;
     }
-};
+    for (string& f : run_files)
+        runs.push_back(new ExternalRun(f));
+    std::sort(records.begin(), records.end(), by_dict_pos);
+    runs.push_back(new ExternalRun(&records));
+
+    // 3. One pass over the dictionary.
+    PhaseTime copy_start = phase_time_now();
+    ifstream dict(dict_section.file_name, ifstream::binary);
+    if (!dict) {
+        cerr << "Error: can't open dictionary file " << dict_section.file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    uint64_t dict_size = (dict_section.length >= 0 ? dict_section.length : file_size(&dict))
+                         / sizeof(T);
+    uint64_t block_size = std::max<uint64_t>(memory_budget / 2 / sizeof(T), 1);
+    std::vector<T> block(block_size);
+    // (dictionary position, run) of each run's next record, smallest first
+    typedef std::pair<uint64_t, size_t> Head;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads;
+    for (size_t r = 0; r < runs.size(); r++) {
+        if (runs[r]->peek() != NULL) heads.push(Head(runs[r]->peek()->dict_pos, r));
+    }
+    // Copies that continue past the end of the current block.
+    std::vector<ExternalCopy> pending, next_pending;
+    uint64_t block_start = 0, block_end = 0;
+    while (!heads.empty() || !pending.empty()) {
+        block_start = pending.empty() ? heads.top().first : block_end;
+        dict.clear();
+        dict.seekg(dict_section.offset + block_start * sizeof(T));
+        uint64_t wanted = block_start < dict_size ? std::min(block_size, dict_size - block_start) : 0;
+        dict.read(reinterpret_cast<char*>(block.data()), wanted * sizeof(T));
+        block_end = block_start + dict.gcount() / sizeof(T);
+        if (block_end == block_start) {
+            cerr << "Error: a token reaches past the end of the dictionary, at "
+                 << block_start << " symbols\n";
+            for (string& f : run_files)
+                std::remove(f.c_str());
+            exit(EXIT_INVALID_INPUT);
+        }
+        next_pending.clear();
+        auto copy = [&](ExternalCopy c) {
+            uint64_t n = std::min(c.length, block_end - c.dict_pos);
+            memcpy(out + c.out_pos, &block[c.dict_pos - block_start], n * sizeof(T));
+            if (n < c.length)
+                next_pending.push_back({ c.dict_pos + n, c.length - n, c.out_pos + n });
+        };
+        for (ExternalCopy& c : pending)
+            copy(c);
+        while (!heads.empty() && heads.top().first < block_end) {
+            size_t r = heads.top().second;
+            heads.pop();
+            copy(*runs[r]->peek());
+            runs[r]->pop();
+            if (runs[r]->peek() != NULL) heads.push(Head(runs[r]->peek()->dict_pos, r));
+        }
+        pending.swap(next_pending);
+    }
+    stats->dict_load = phase_time_since(copy_start);
+
+    for (ExternalRun* run : runs)
+        delete run;
+    for (string& f : run_files)
+        std::remove(f.c_str());
+    if (out != NULL) munmap(out, total * sizeof(T));
+    close(out_fd);
+    if (stats->perf != NULL) stats->perf->stop();
+    stats->decode = phase_time_since(decode_start);
+    stats->decode.wall -= stats->dict_load.wall;
+    stats->decode.cpu -= stats->dict_load.cpu;
+    return (toks_read << 32) | total;
+}
 
 
 int main(int argc, char **argv) {
@@ -277,11 +514,19 @@ int main(int argc, char **argv) {
     string input_file_name = "";
     string output_file_name = "";
     int symbol_width_bits = 8;
+    bool width_given = false; // a bundle has its own
     string input_format = "";
     int input_mode = FMT_32X2;
     long long start_pos = 0;
     long long stop_pos = 0;
     bool quiet_mode = false;
+    int alloc_mode = ALLOC_HEAP;
+    bool stats_mode = false, stats_json = false;
+    bool literal_runs = false;
+    bool sparse_mode = false;
+    uint64_t external_memory = 0; // bytes; 0 if not --external-memory
+    string index_file_name = "";
+    string alphabet_file_name = "";
 
     /* Argument parsing *****/
     int i = 1;
@@ -314,10 +559,11 @@ int main(int argc, char **argv) {
             }
             i++;
             symbol_width_bits = atoi(argv[i]);
-            if ((symbol_width_bits != 8) && (symbol_width_bits != 16) && (symbol_width_bits != 32) && (symbol_width_bits != 64)) {
-                cerr << "Bad arguments: width wasn't 8, 16, 32, or 64.\n";
+            if (!is_symbol_width(symbol_width_bits)) {
+                cerr << "Bad arguments: width wasn't 8, 16, 24, 32, 40, 48, or 64.\n";
                 exit(EXIT_USER_ERROR);
             }
+            width_given = true;
         } else if (arg_i.compare("-f") == 0 || arg_i.compare("--input-fmt") == 0) {
             if (argc < i + 2) {
                 cerr << "Bad arguments: no input format after " << arg_i << endl;
@@ -345,6 +591,45 @@ int main(int argc, char **argv) {
                 stop_pos = 0;
         } else if (arg_i.compare("-q") == 0 || arg_i.compare("--quiet") == 0) {
             quiet_mode = true;
+        } else if (arg_i.compare("--literal-runs") == 0) {
+            literal_runs = true;
+        } else if (arg_i.compare("--sparse") == 0) {
+            sparse_mode = true;
+        } else if (arg_i.compare("--external-memory") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no memory size after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            long long mb = atoll(argv[++i]);
+            if (mb <= 0) {
+                cerr << "Bad arguments: memory size must be a positive number of megabytes\n";
+                exit(EXIT_USER_ERROR);
+            }
+            external_memory = (uint64_t) mb << 20;
+        } else if (arg_i.compare("--index") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no filename after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            index_file_name = string(argv[++i]);
+        } else if (arg_i.compare("--alphabet") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no filename after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            alphabet_file_name = string(argv[++i]);
+        } else if (arg_i.compare("--huge-pages") == 0) {
+            alloc_mode = (alloc_mode & ~ALLOC_MODE_MASK) | ALLOC_HUGEPAGE;
+        } else if (arg_i.compare("--hugetlb") == 0) {
+            alloc_mode = (alloc_mode & ~ALLOC_MODE_MASK) | ALLOC_HUGETLB;
+        } else if (arg_i.compare("--numa-interleave") == 0) {
+            alloc_mode |= ALLOC_NUMA_INTERLEAVE;
+        } else if (arg_i.compare("--stats") == 0) {
+            stats_mode = true;
+            stats_json = false;
+        } else if (arg_i.compare("--stats-json") == 0) {
+            stats_mode = true;
+            stats_json = true;
         } else {
             cerr << "Unknown argument '" << arg_i << "'; give input file with -i.\n";
             exit(EXIT_USER_ERROR);
@@ -357,11 +642,77 @@ int main(int argc, char **argv) {
         exit(EXIT_USER_ERROR);
     }
 
+    if (sparse_mode && stop_pos == 0) {
+        cerr << "Bad arguments: --sparse needs --to.\n";
+        exit(EXIT_USER_ERROR);
+    }
+
+    if (sparse_mode && alloc_mode != ALLOC_HEAP) {
+        cerr << "Bad arguments: --sparse doesn't load the dictionary into memory, "
+                "so it can't go in huge pages or be interleaved.\n";
+        exit(EXIT_USER_ERROR);
+    }
+
+    if (external_memory > 0 && (start_pos > 0 || stop_pos > 0 || sparse_mode)) {
+        cerr << "Bad arguments: --external-memory decompresses the whole file; "
+                "it can't be combined with --from, --to or --sparse.\n";
+        exit(EXIT_USER_ERROR);
+    }
+
+    if (external_memory > 0 && alloc_mode != ALLOC_HEAP) {
+        cerr << "Bad arguments: --external-memory doesn't load the dictionary into memory, "
+                "so it can't go in huge pages or be interleaved.\n";
+        exit(EXIT_USER_ERROR);
+    }
+
     if (dict_file_name.length() == 0) {
         cerr << "Bad arguments: dictionary file name not specified.\n";
         exit(EXIT_USER_ERROR);
     }
 
+    /* With --alphabet, -w is the output's width, and the dictionary is made
+     * of the alphabet's ranks, which are narrower. */
+    int dict_width_bits = symbol_width_bits;
+    Alphabet alphabet;
+    bool has_alphabet = alphabet_file_name.length() > 0;
+    if (has_alphabet) {
+        if (!alphabet.load(alphabet_file_name)) {
+            cerr << "Error: can't read " << alphabet_file_name
+                 << ", or it isn't an alphabet made by rlztools.alphabet\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        dict_width_bits = alphabet.rank_width();
+        if (dict_width_bits == 0 || dict_width_bits >= symbol_width_bits) {
+            cerr << "Bad arguments: " << alphabet_file_name << " has " << alphabet.size()
+                 << " symbols, whose ranks aren't narrower than " << symbol_width_bits
+                 << "-bit output;\ngive the output's width with -w.\n";
+            exit(EXIT_USER_ERROR);
+        }
+        if (sparse_mode || external_memory > 0) {
+            cerr << "Bad arguments: --sparse and --external-memory copy the dictionary as it is, "
+                    "so they can't be combined with --alphabet.\n";
+            exit(EXIT_USER_ERROR);
+        }
+    }
+
+    /* An .rlzdict bundle knows its width, and is mapped (where the whole
+     * dictionary is wanted) unless it's wanted in huge pages. */
+    DictBundleHeader bundle;
+    bool is_bundle = read_dict_bundle(dict_file_name, &bundle);
+    if (is_bundle) {
+        if ((width_given || has_alphabet) && dict_width_bits != (int) bundle.symbol_width) {
+            cerr << "Bad arguments: " << dict_file_name << " has "
+                 << bundle.symbol_width << "-bit symbols.\n";
+            exit(EXIT_USER_ERROR);
+        }
+        dict_width_bits = bundle.symbol_width;
+        if (!has_alphabet) symbol_width_bits = dict_width_bits;
+        if (alloc_mode == ALLOC_HEAP && !sparse_mode && external_memory == 0)
+            alloc_mode = ALLOC_MMAP;
+    }
+    FileSection dict_section = bundle_section(is_bundle ? &bundle : NULL,
+                                              dict_file_name, RLZDICT_DICT);
+
     if (input_file_name.length() == 0) {
         cerr << "Bad arguments: input file name not specified.\n";
         exit(EXIT_USER_ERROR);
@@ -383,8 +734,10 @@ int main(int argc, char **argv) {
         input_mode = FMT_ASCII;
     } else if (input_format.compare("vbyte") == 0) {
         input_mode = FMT_VBYTE;
+    } else if (input_format.compare("delta") == 0) {
+        input_mode = FMT_DELTA;
     } else {
-        cerr << "Bad arguments: input format not \"32x2\", \"64x2\", \"ascii\" or \"vbyte\".\n";
+        cerr << "Bad arguments: input format not \"32x2\", \"64x2\", \"ascii\", \"vbyte\" or \"delta\".\n";
         exit(EXIT_USER_ERROR);
     }
     /* end argument parsing *****/
@@ -401,29 +754,144 @@ int main(int argc, char **argv) {
     }
 
     RLZInputReader inputreader(input_file_name, input_mode);
+    if (literal_runs)
+        inputreader.literal_width = symbol_width_bits / 8;
+
+    /* With a phrase index, -a doesn't need to read through every token
+     * before it: jump to the token with symbol I in it (or in the formats
+     * that need byte offsets, the last indexed token before that one). */
+    long long skipped_symbols = 0;
+    if (index_file_name.length() > 0 && start_pos > 0) {
+        PhraseIndex index(index_file_name);
+        if (index.mode != input_mode) {
+            cerr << "Error: phrase index " << index_file_name
+                 << " was made for another --input-fmt\n";
+            exit(EXIT_USER_ERROR);
+        }
+        uint64_t t = index.token_at(start_pos - 1);
+        uint64_t offset = 0, delta_state = 0;
+        if (index.interval == 0 && literal_runs) {
+            cerr << "Error: phrase index " << index_file_name
+                 << " was made without --literal-runs\n";
+            exit(EXIT_USER_ERROR);
+        } else if (index.interval == 0) {
+            offset = t * (input_mode == FMT_32X2 ? 8 : 16);
+        } else if (index.tokens() > 0) {
+            uint64_t sample = (t < index.tokens() ? t : index.tokens() - 1) / index.interval;
+            t = sample * index.interval;
+            offset = index.offsets[sample];
+            delta_state = index.delta_states[sample];
+        }
+        skipped_symbols = t == 0 ? 0 : index.phrase_end(t - 1);
+        inputreader.seek(offset, delta_state);
+    }
 
+    PerfCounters perf;
+    UnparseStats stats;
+    stats.perf = stats_mode ? &perf : NULL;
     uint64_t x = 0;
     switch (symbol_width_bits) {
-        case 8: {
-            OutputWriter<uint8_t> ow = OutputWriter<uint8_t>(dict_file_name, output_file_name);
-            x += ow.unparse(&inputreader, start_pos, stop_pos);
+        case 8:
+            if (external_memory > 0)
+                x += run_external<uint8_t>(dict_section, output_file_name, &inputreader,
+                                           external_memory, &stats);
+            else if (sparse_mode)
+                x += run_sparse<uint8_t>(dict_section, output_file_name, &inputreader,
+                                         start_pos, stop_pos, skipped_symbols, &stats);
+            else
+                x += run_unparser<uint8_t>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                           &inputreader, start_pos, stop_pos, skipped_symbols, &stats);
             break;
-        }
-        case 16: {
-            OutputWriter<uint16_t> ow = OutputWriter<uint16_t>(dict_file_name, output_file_name);
-            x += ow.unparse(&inputreader, start_pos, stop_pos);
+        case 16:
+            if (has_alphabet)
+                x += run_alphabet_unparser<uint16_t>(dict_width_bits, &alphabet, dict_section,
+                                                     output_file_name, alloc_mode, quiet_mode, &inputreader,
+                                                     start_pos, stop_pos, skipped_symbols, &stats);
+            else if (external_memory > 0)
+                x += run_external<uint16_t>(dict_section, output_file_name, &inputreader,
+                                            external_memory, &stats);
+            else if (sparse_mode)
+                x += run_sparse<uint16_t>(dict_section, output_file_name, &inputreader,
+                                          start_pos, stop_pos, skipped_symbols, &stats);
+            else
+                x += run_unparser<uint16_t>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                            &inputreader, start_pos, stop_pos, skipped_symbols, &stats);
             break;
-        }
-        case 32: {
-            OutputWriter<uint32_t> ow = OutputWriter<uint32_t>(dict_file_name, output_file_name);
-            x += ow.unparse(&inputreader, start_pos, stop_pos);
+        case 32:
+            if (has_alphabet)
+                x += run_alphabet_unparser<uint32_t>(dict_width_bits, &alphabet, dict_section,
+                                                     output_file_name, alloc_mode, quiet_mode, &inputreader,
+                                                     start_pos, stop_pos, skipped_symbols, &stats);
+            else if (external_memory > 0)
+                x += run_external<uint32_t>(dict_section, output_file_name, &inputreader,
+                                            external_memory, &stats);
+            else if (sparse_mode)
+                x += run_sparse<uint32_t>(dict_section, output_file_name, &inputreader,
+                                          start_pos, stop_pos, skipped_symbols, &stats);
+            else
+                x += run_unparser<uint32_t>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                            &inputreader, start_pos, stop_pos, skipped_symbols, &stats);
             break;
-        }
-        case 64: {
-            OutputWriter<uint64_t> ow = OutputWriter<uint64_t>(dict_file_name, output_file_name);
-            x += ow.unparse(&inputreader, start_pos, stop_pos);
+        case 24:
+            if (has_alphabet)
+                x += run_alphabet_unparser<packed24>(dict_width_bits, &alphabet, dict_section,
+                                                     output_file_name, alloc_mode, quiet_mode, &inputreader,
+                                                     start_pos, stop_pos, skipped_symbols, &stats);
+            else if (external_memory > 0)
+                x += run_external<packed24>(dict_section, output_file_name, &inputreader,
+                                            external_memory, &stats);
+            else if (sparse_mode)
+                x += run_sparse<packed24>(dict_section, output_file_name, &inputreader,
+                                          start_pos, stop_pos, skipped_symbols, &stats);
+            else
+                x += run_unparser<packed24>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                            &inputreader, start_pos, stop_pos, skipped_symbols, &stats);
+            break;
+        case 40:
+            if (has_alphabet)
+                x += run_alphabet_unparser<packed40>(dict_width_bits, &alphabet, dict_section,
+                                                     output_file_name, alloc_mode, quiet_mode, &inputreader,
+                                                     start_pos, stop_pos, skipped_symbols, &stats);
+            else if (external_memory > 0)
+                x += run_external<packed40>(dict_section, output_file_name, &inputreader,
+                                            external_memory, &stats);
+            else if (sparse_mode)
+                x += run_sparse<packed40>(dict_section, output_file_name, &inputreader,
+                                          start_pos, stop_pos, skipped_symbols, &stats);
+            else
+                x += run_unparser<packed40>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                            &inputreader, start_pos, stop_pos, skipped_symbols, &stats);
+            break;
+        case 48:
+            if (has_alphabet)
+                x += run_alphabet_unparser<packed48>(dict_width_bits, &alphabet, dict_section,
+                                                     output_file_name, alloc_mode, quiet_mode, &inputreader,
+                                                     start_pos, stop_pos, skipped_symbols, &stats);
+            else if (external_memory > 0)
+                x += run_external<packed48>(dict_section, output_file_name, &inputreader,
+                                            external_memory, &stats);
+            else if (sparse_mode)
+                x += run_sparse<packed48>(dict_section, output_file_name, &inputreader,
+                                          start_pos, stop_pos, skipped_symbols, &stats);
+            else
+                x += run_unparser<packed48>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                            &inputreader, start_pos, stop_pos, skipped_symbols, &stats);
+            break;
+        case 64:
+            if (has_alphabet)
+                x += run_alphabet_unparser<uint64_t>(dict_width_bits, &alphabet, dict_section,
+                                                     output_file_name, alloc_mode, quiet_mode, &inputreader,
+                                                     start_pos, stop_pos, skipped_symbols, &stats);
+            else if (external_memory > 0)
+                x += run_external<uint64_t>(dict_section, output_file_name, &inputreader,
+                                            external_memory, &stats);
+            else if (sparse_mode)
+                x += run_sparse<uint64_t>(dict_section, output_file_name, &inputreader,
+                                          start_pos, stop_pos, skipped_symbols, &stats);
+            else
+                x += run_unparser<uint64_t>(dict_section, output_file_name, alloc_mode, quiet_mode,
+                                            &inputreader, start_pos, stop_pos, skipped_symbols, &stats);
             break;
-        }
         default:
             cerr << "Bug: unknown symbol_width_bits " << symbol_width_bits << "\n";
             exit(EXIT_BUG);
@@ -440,6 +908,29 @@ int main(int argc, char **argv) {
         }
     }
 
+    // Printed even with -q, like in rlzparse.
+    if (stats_mode) {
+        uint32_t num_tokens = x >> 32;
+        uint32_t num_symbols = x & 0xFFFFFFFF;
+        if (stats_json) {
+            std::cout << std::fixed << std::setprecision(6)
+                      << "{\"phases\": {\"dict_load\": {\"wall_s\": " << stats.dict_load.wall
+                      << ", \"cpu_s\": " << stats.dict_load.cpu
+                      << "}, \"decode\": {\"wall_s\": " << stats.decode.wall
+                      << ", \"cpu_s\": " << stats.decode.cpu
+                      << "}}, \"tokens\": " << num_tokens
+                      << ", \"output_symbols\": " << num_symbols
+                      << ", \"decode_perf\": " << perf.json() << "}" << endl;
+        } else {
+            cerr << std::fixed << std::setprecision(3)
+                 << "phase        wall (s)  cpu (s)\n"
+                 << "dict_load  " << std::setw(10) << stats.dict_load.wall
+                 << std::setw(9) << stats.dict_load.cpu << "\n"
+                 << "decode     " << std::setw(10) << stats.decode.wall
+                 << std::setw(9) << stats.decode.cpu << "\n"
+                 << "in the decode phase:\n" << perf.report(num_symbols);
+        }
+    }
+
     return 0;
 }
-
@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2023 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* OutputWriter, the decoding loop of rlzunparse, which rlzunparse.cpp
+ * runs and bench/microbench.cpp times. */
+#ifndef RLZ_UNPARSE_H_INCLUDED
+#define RLZ_UNPARSE_H_INCLUDED
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include "rlzcommon.h"
+
+using std::hex;
+using std::dec;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::ifstream;
+using std::ofstream;
+
+
+/* OutputWriter is our unparser class: it reads from an RLZInputReader,
+ * then writes T-type items (uint8_t, 16_t, 32_t, 64_t).
+ * It also does the arbitrary-decompression-position math, counting in
+ * T-sized symbols, not in bytes.
+ * It's used by initializing with dictionary and output file names
+ * (which it will open as files), then calling unparse() with an
+ * RLZInputReader parameter; unparse() will read input tokens and
+ * call write_next() to do output. */
+template <typename T, typename D = T> class OutputWriter {
+private:
+    FileReader<D> dict_file;
+    SymbolView<D> dict;
+    long dict_size;
+    ofstream outfile;
+    bool literal_runs; // set from the RLZInputReader in unparse()
+    std::vector<T> literal_buf; // the symbols of the current literal run
+    const Alphabet* alphabet; // with --alphabet, D are ranks in it; else NULL
+public:
+    OutputWriter(FileSection dict_section, string output_file_name,
+                 int alloc_mode = ALLOC_HEAP, const Alphabet* alphabet = NULL)
+        : dict_file(dict_section, false, alloc_mode), dict(dict_file.view()),
+          alphabet(alphabet)
+    {
+        dict_size = dict.size();
+        literal_runs = false;
+        outfile = ofstream(output_file_name, ofstream::binary | ofstream::trunc);
+        if (!outfile) {
+            cerr << "Error: cannot open output file '" << output_file_name << "'\n";
+            exit(1);
+        }
+    }
+
+    long long write_next(RLZToken token, long long start = 0, long long stop = 0) {
+        long long pos = token.start_pos;
+        long long len = token.length;
+        char bytebuf[sizeof(T)];
+        T* outbuf = reinterpret_cast<T*>(bytebuf);
+
+        if (len == 0 && literal_runs) {
+            // the whole run of literals, or its [start, stop) part
+            if (stop <= 0)
+                stop = literal_buf.size();
+            outfile.write(reinterpret_cast<const char*>(literal_buf.data() + start),
+                          (stop - start) * sizeof(T));
+            return stop - start;
+        } else if (len == 0) {
+            // output a literal
+            outbuf[0] = (T) pos;
+            for (uint64_t i = 0; i < sizeof(T); i++) outfile.put(bytebuf[i]);
+            return 1L;
+        } else {
+            if (stop <= 0)
+                stop = len;
+            long token_end = pos + stop;
+            // off-by-one arithmetic check:
+            // dict size 8 = indices 0 (inclusive) to 8 (exclusive)
+            // 0  1  2  3  4  5  6  7  ! <- out of bounds
+            // token (6, 2) =>   1  2     ok. 6 + 2 = 8, 8 <= dict_size.
+            // token (7, 1) =>      1     ok, 7 + 1 = 8, 8 <= dict_size.
+            // token (7, 2) =>      1  2  not ok: 7 + 2 = 9, 9 > dict_size.
+            if (token_end > dict_size) {
+                cerr << "Warning: token (0x" << hex << pos << ", 0x" << len << ") exceeds dictionary length of " << dec << dict_size << ", truncating.\n";
+                token_end = dict_size;
+            }
+            for (long x = pos + start; x < token_end; x++) {
+                outbuf[0] = alphabet != NULL ? (T) alphabet->symbol(dict[x]) : (T) dict[x];
+                for (size_t i = 0; i < sizeof(T); i++) outfile.put(bytebuf[i]);
+            }
+            return token.length;
+        }
+    }
+
+    string dict_memory_report() {
+        return dict_file.memory_report();
+    }
+
+    SymbolView<D> dictionary() {
+        return dict;
+    }
+
+    PhaseTime dict_load_time() {
+        return dict_file.load_time;
+    }
+
+    // returns two 32-bit values packed into one 64-bit int
+    // output_pos is the number of symbols before the inputreader's position,
+    // if it's been seek()ed into the middle of the file with a PhraseIndex.
+    uint64_t unparse(RLZInputReader* inputreader, long long start_pos, long long stop_pos,
+                     long long output_pos = 0) {
+        long long toks_read = 0;
+        long long syms_written = 0;
+        // output_pos: 1-based index of the last symbol of the most recent
+        // token processed
+        literal_runs = inputreader->literal_width > 0;
+        //cerr << "start " << start_pos << " stop " << stop_pos << "\n";
+        while (inputreader->keep_going()) {
+            RLZToken tok = inputreader->next_token();
+            if (is_end_sentinel(&tok))
+                break;
+            toks_read++;
+            long long effective_token_length = tok.length == 0 ? 1 : tok.length;
+            if (literal_runs && tok.length == 0) {
+                // Read in even if it's outside -a/-b, to get past it.
+                if (tok.start_pos == 0 || tok.start_pos > LITERAL_RUN_MAX) {
+                    cerr << "Error: literal run of " << tok.start_pos
+                         << " symbols; is this file really --literal-runs?\n";
+                    exit(EXIT_INVALID_INPUT);
+                }
+                literal_buf.resize(tok.start_pos);
+                inputreader->read_literals(literal_buf.data(), tok.start_pos);
+                effective_token_length = tok.start_pos;
+            }
+
+            if (start_pos == 0 && stop_pos == 0) {
+                syms_written += this->write_next(tok);
+            } else {
+                // Calculating what segment of the output text this token
+                // represents, and whether it's one we need to care about.
+                // token_start_pos is the index of token's character 0
+                // (0-based indexing) in terms of the output text (1-based)
+                long long token_start_pos = output_pos + 1;
+                long long token_end_pos = output_pos + effective_token_length;
+                //cerr << "(pos="<< tok.start_pos << " len=" << tok.length << " sp=" << token_start_pos << " ep=" << token_end_pos << " outp=" << output_pos << ") ";
+
+                // Start at position I, continue until end.
+                if (start_pos > 0 && stop_pos == 0) {
+                    //cerr << "1 ";
+                    if (token_start_pos >= start_pos) { // this had output_pos >= start_pos, so if it breaks check that
+                        syms_written += this->write_next(tok);
+                    } else if (token_start_pos < start_pos && token_end_pos >= start_pos) {
+                        // "start at character 5", start_pos = 5
+                        // token has length = 4
+                        // before: offset = 2
+                        //         token_start_pos = 2 + 1 = 3
+                        //         token_end_pos = 2 + 4 = 6
+                        // 0 1 2 3 4 5 6 7 8 9
+                        //   a b b a b a a b c
+                        //   * *                already decoded part
+                        //       * * * *        token's phrase
+                        //       0 1 2 3        token-internal indices
+                        //           * *        part we want to keep, starting at 2
+                        // different case: we start at exactly the token's start
+                        // before: offset = 4, token_start_pos = 5, end_pos = 8
+                        // 0 1 2 3 4 5 6 7 8 9
+                        //   a b b a b a a b c
+                        //   * * * *            already decoded part
+                        //           * * * *    token's phrase
+                        //           0 1 2 3
+                        // the correct calculation is start_pos - token_start_pos
+
+                        // Converting both to token-internal indexing and 0-based indexing.
+                        long long start = start_pos - token_start_pos;
+                        long long stop = effective_token_length;
+                        syms_written += this->write_next(tok, start, stop);
+                    } else {
+                        //cerr << "skip ";
+                        // This token occurs before the bit to output starts.
+                        ;
+                    }
+                    output_pos = token_end_pos;
+                // Start at beginning, continue until position J.
+                } else if (start_pos == 0 && stop_pos > 0) {
+                    //cerr << "2 ";
+                    if (token_end_pos < stop_pos) {
+                        syms_written += this->write_next(tok);
+                    } else if (token_start_pos <= stop_pos && token_end_pos >= stop_pos) {
+                        // stop_pos = 6
+                        // token has length = 4, starting with offset = 3
+                        // token_start = 3+1=4, token_end = 3+4=7
+                        // 0 1 2 3 4 5 6 7 8 9
+                        //   a b b a b a a b c
+                        //   * * *              already written
+                        //         * * * *      token's text
+                        //         0 1 2 3      token's indices
+                        //         * * *        all we want to keep
+                        // write_next uses a < comparison, so
+                        // token_end - stop_pos = 1 is number of chars to skip
+                        // tok->length - token_end + stop_pos
+                        // tok->length + stop_pos - token_end stays positive
+                        long long start = 0;
+                        long long stop = effective_token_length + stop_pos - token_end_pos;
+                        syms_written += this->write_next(tok, start, stop);
+                    } else {
+                        //cerr << "skip\n";
+                        // This token occurs wholly after position J.
+                        break;
+                    }
+                    output_pos = token_end_pos;
+                // Start at position I, stop at position J.
+                // start_pos = 4, stop_pos = 6
+                // 0 1 2 3 4 5 6 7 8 9
+                //         * * * *      all we want to output
+                //   * *           * *  case 1: token entirely outside range
+                //           * *        case 2: token entirely inside range
+                //     * * * *          case 3: token overlaps start of range
+                //             * * * *  case 4: token overlaps end of range
+                //       * * * * * *    case 5: range entirely inside token
+                } else {
+                    //cerr << "3-";
+                    if (token_start_pos > stop_pos || token_end_pos < start_pos) {
+                        //cerr << "1 ";
+                        // case 1: token entirely outside range
+                        if (token_start_pos > stop_pos)
+                            break;
+                    } else if (token_start_pos >= start_pos && token_end_pos <= stop_pos) {
+                        //cerr << "2 ";
+                        // case 2: token entirely inside range
+                        syms_written += this->write_next(tok);
+                    } else if (token_start_pos <= start_pos && token_end_pos <= stop_pos) {
+                        //cerr << "3 ";
+                        // case 3: token overlaps start of range
+                        long long start = start_pos - token_start_pos;
+                        long long stop = effective_token_length;
+                        syms_written += this->write_next(tok, start, stop);
+                    } else if (token_start_pos >= start_pos && token_end_pos >= stop_pos) {
+                        //cerr << "4 ";
+                        // case 4: token overlaps end of range
+                        long long start = 0;
+                        long long stop = effective_token_length + stop_pos - token_end_pos;
+                        syms_written += this->write_next(tok, start, stop);
+                    } else {
+                        //cerr << "5 ";
+                        // case 5: token overlaps entire range
+                        long long start = start_pos - token_start_pos;
+                        long long stop = effective_token_length + stop_pos - token_end_pos;
+                        syms_written += this->write_next(tok, start, stop);
+                    }
+                    output_pos = token_end_pos;
+                }
+                //cerr << "\n";
+            }
+        }
+        return (toks_read << 32) | syms_written;
+    }
+};
+
+#endif // include guard, RLZ_UNPARSE_H_INCLUDED
@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: MPL-2.0
+ *
+ * Copyright 2026 Eve Kivivuori
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+/* sparsesa: build a sparse suffix array of a dictionary, for
+ * rlzparse --sparse-sa: the suffixes that start at every K'th position,
+ * sorted. It's K times smaller than the full suffix array and is sorted
+ * straight from the dictionary, so no full suffix array is needed first.
+ *
+ * The sort compares suffixes symbol by symbol, so it gets slow on very
+ * repetitive dictionaries, where suffixes share long prefixes; for those,
+ * build the full suffix array and pass it with --from-sa to keep only the
+ * suffixes starting at multiples of K.
+ */
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "rlzcommon.h"
+
+using std::cerr;
+using std::endl;
+using std::string;
+
+void print_help() {
+    cerr << "Usage: sparsesa [-w WIDTH] [-W 32/64] [--from-sa SA_FILE] -k K DICT_FILE OUTFILE\n"
+            "-w 8/16/24/32/40/48/64: symbol width of dictionary, default 8\n"
+            "-W 32/64: integer width of suffix array file, default 32\n"
+            "-k K: keep the suffixes starting at every K'th symbol\n"
+            "--from-sa SA_FILE: take them from this full suffix array instead of sorting\n"
+            "Suffix arrays are in platform-native byte order.\n";
+}
+
+template <typename T, typename S>
+void build(string dict_file_name, string sa_file_name, string output_file_name,
+           long long k)
+{
+    FileReader<T> dict_file(dict_file_name);
+    SymbolView<T> dict = dict_file.view();
+    std::vector<S> sparse;
+    sparse.reserve(dict.size() / k + 1);
+    if (sa_file_name.length() > 0) {
+        FileReader<S> sa_file(sa_file_name, false, ALLOC_UNPACK_SA);
+        SymbolView<S> sa = sa_file.view();
+        if (sa.size() != dict.size()) {
+            cerr << "Error: " << sa_file_name << " has " << sa.size()
+                 << " suffixes, but the dictionary has " << dict.size() << " symbols\n";
+            exit(EXIT_INVALID_INPUT);
+        }
+        for (long long i = 0; i < sa.size(); i++) {
+            if (sa[i] % k == 0) sparse.push_back(sa[i]);
+        }
+    } else {
+        for (long long p = 0; p < dict.size(); p += k)
+            sparse.push_back((S) p);
+        const T* d = dict.data();
+        const T* end = d + dict.size();
+        // A suffix that's a prefix of another sorts first, like in the full SA.
+        std::sort(sparse.begin(), sparse.end(), [=](S a, S b) {
+            return std::lexicographical_compare(d + a, end, d + b, end);
+        });
+    }
+    std::ofstream outfile(output_file_name, std::ofstream::binary | std::ofstream::trunc);
+    outfile.write(reinterpret_cast<const char*>(sparse.data()), sparse.size() * sizeof(S));
+    if (!outfile) {
+        cerr << "Error: can't write " << output_file_name << "\n";
+        exit(EXIT_INVALID_INPUT);
+    }
+    cerr << output_file_name << ": " << sparse.size() << " suffixes of "
+         << dict.size() << "\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    int dict_width = 8;
+    int sa_width = 32;
+    long long k = 0;
+    string sa_file_name = "";
+    string dict_file_name = "";
+    string output_file_name = "";
+
+    int i = 1;
+    while (i < argc) {
+        string arg_i = string(argv[i]);
+        if (arg_i.compare("--help") == 0) {
+            print_help(); exit(0);
+        } else if (arg_i.compare("-w") == 0 || arg_i.compare("--width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            dict_width = atoi(argv[++i]);
+            if (!is_symbol_width(dict_width)) {
+                cerr << "Bad arguments: width wasn't 8, 16, 24, 32, 40, 48, or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("-W") == 0 || arg_i.compare("--sa-width") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no width after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            sa_width = atoi(argv[++i]);
+            if ((sa_width != 32) && (sa_width != 64)) {
+                cerr << "Bad arguments: SA symbol width wasn't 32 or 64" << endl;
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("-k") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no K after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            k = atoll(argv[++i]);
+            if (k <= 0) {
+                cerr << "Bad arguments: K must be positive\n";
+                exit(EXIT_USER_ERROR);
+            }
+        } else if (arg_i.compare("--from-sa") == 0) {
+            if (argc < i + 2) {
+                cerr << "Bad arguments: no filename after " << arg_i << endl;
+                exit(EXIT_USER_ERROR);
+            }
+            sa_file_name = string(argv[++i]);
+        } else if (dict_file_name.length() == 0) {
+            dict_file_name = arg_i;
+        } else if (output_file_name.length() == 0) {
+            output_file_name = arg_i;
+        } else {
+            cerr << "Bad arguments: too many filenames" << endl;
+            exit(EXIT_USER_ERROR);
+        }
+        i++;
+    }
+
+    if (k == 0 || dict_file_name.length() == 0 || output_file_name.length() == 0) {
+        print_help();
+        exit(EXIT_USER_ERROR);
+    }
+
+    switch (dict_width) {
+        case 8:
+            if (sa_width == 32) build<uint8_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, k);
+            else build<uint8_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, k);
+            break;
+        case 16:
+            if (sa_width == 32) build<uint16_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, k);
+            else build<uint16_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, k);
+            break;
+        case 32:
+            if (sa_width == 32) build<uint32_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, k);
+            else build<uint32_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, k);
+            break;
+        case 24:
+            if (sa_width == 32) build<packed24, uint32_t>(dict_file_name, sa_file_name, output_file_name, k);
+            else build<packed24, uint64_t>(dict_file_name, sa_file_name, output_file_name, k);
+            break;
+        case 40:
+            if (sa_width == 32) build<packed40, uint32_t>(dict_file_name, sa_file_name, output_file_name, k);
+            else build<packed40, uint64_t>(dict_file_name, sa_file_name, output_file_name, k);
+            break;
+        case 48:
+            if (sa_width == 32) build<packed48, uint32_t>(dict_file_name, sa_file_name, output_file_name, k);
+            else build<packed48, uint64_t>(dict_file_name, sa_file_name, output_file_name, k);
+            break;
+        case 64:
+            if (sa_width == 32) build<uint64_t, uint32_t>(dict_file_name, sa_file_name, output_file_name, k);
+            else build<uint64_t, uint64_t>(dict_file_name, sa_file_name, output_file_name, k);
+            break;
+        default:
+            cerr << "bug: unknown dict_width=" << dict_width << "\n";
+            exit(EXIT_BUG);
+    }
+    return 0;
+}
@@ -29,15 +29,15 @@ void print_help() {
 
 
 template <typename T, typename S>
-void print_suffixes(FileReader<T>* dict, FileReader<S>* sa) {
+void print_suffixes(SymbolView<T> dict, SymbolView<S> sa) {
     int chars_per_symbol = sizeof(T) == 1 ? 1 : 1 + sizeof(T)*2; // Two nybbles per byte + space
-    for (int i = 0; i < sa->size(); i++) {
-        S idx = (*sa)[i];
+    for (int i = 0; i < sa.size(); i++) {
+        S idx = sa[i];
         // Don't print past end-of-file, or the width of the screen
-        long num_print = (dict->size() - idx) * chars_per_symbol > 56 ? 56 / chars_per_symbol : (dict->size() - idx);
+        long num_print = (dict.size() - idx) * chars_per_symbol > 56 ? 56 / chars_per_symbol : (dict.size() - idx);
         cout << std::dec << i << " 0x" << std::hex << idx << " " << std::dec << num_print << ":\t";
         for (unsigned int j = idx; j < idx + num_print; j++) {
-            cout << dict->as_string(j);
+            cout << symbol_as_string(dict[j]);
             if (chars_per_symbol > 1 && j+1 != idx+num_print)
                 cout << " ";
         }
@@ -109,13 +109,13 @@ int main(int argc, char** argv) {
             switch (sa_width) {
                 case 64: {
                     FileReader<uint64_t> sa = FileReader<uint64_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
                 default:
                 case 32: {
                     FileReader<uint32_t> sa = FileReader<uint32_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
             }
@@ -126,13 +126,13 @@ int main(int argc, char** argv) {
             switch (sa_width) {
                 case 64: {
                     FileReader<uint64_t> sa = FileReader<uint64_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
                 default:
                 case 32: {
                     FileReader<uint32_t> sa = FileReader<uint32_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
             }
@@ -149,13 +149,13 @@ int main(int argc, char** argv) {
             switch (sa_width) {
                 case 64: {
                     FileReader<uint64_t> sa = FileReader<uint64_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
                 default:
                 case 32: {
                     FileReader<uint32_t> sa = FileReader<uint32_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
             }
@@ -167,13 +167,13 @@ int main(int argc, char** argv) {
             switch (sa_width) {
                 case 64: {
                     FileReader<uint64_t> sa = FileReader<uint64_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
                 default:
                 case 32: {
                     FileReader<uint32_t> sa = FileReader<uint32_t>(sa_file_name);
-                    print_suffixes(&dict, &sa);
+                    print_suffixes(dict.view(), sa.view());
                     break;
                 }
             }
@@ -36,10 +36,12 @@ test_compression 8 32 input/8-in-ababab dict/8-dict-ababab sa/8-dict-ababab vbyt
 test_compression 8 32 input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2 rlz/8-in-abacab-dict-ababab.rlz32
 test_compression 8 32 input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 64x2 rlz/8-in-abacab-dict-ababab.rlz64
 test_compression 8 32 input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab vbyte rlz/8-in-abacab-dict-ababab.rlzv
+test_compression 8 32 input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab delta rlz/8-in-abacab-dict-ababab.rlzd
 
 test_compression 8 32 input/8-in-aaaab dict/8-dict-aaaa sa/8-dict-aaaa 32x2 rlz/8-in-aaaab-dict-aaaa.rlz32
 test_compression 8 32 input/8-in-aaaab dict/8-dict-aaaa sa/8-dict-aaaa 64x2 rlz/8-in-aaaab-dict-aaaa.rlz64
 test_compression 8 32 input/8-in-aaaab dict/8-dict-aaaa sa/8-dict-aaaa vbyte rlz/8-in-aaaab-dict-aaaa.rlzv
+test_compression 8 32 input/8-in-aaaab dict/8-dict-aaaa sa/8-dict-aaaa delta rlz/8-in-aaaab-dict-aaaa.rlzd
 test_compression 8 32 input/8-in-aaaab dict/8-dict-ababab sa/8-dict-ababab vbyte rlz/8-in-aaaab-dict-ababab.rlzv
 
 test_compression 8 32 input/8-in-noise input/8-in-noise sa/8-in-noise 32x2 rlz/8-in-noise-dict-self.rlz32
@@ -49,4 +51,342 @@ test_compression 8 32 input/8-in-noise input/8-in-noise sa/8-in-noise vbyte rlz/
 test_compression 8 32 input/8-in-permu dict/8-dict-permu sa/8-dict-permu 32x2 rlz/8-in-permu-dict-permu.rlz32
 test_compression 8 32 input/8-in-permu dict/8-dict-permu sa/8-dict-permu 64x2 rlz/8-in-permu-dict-permu.rlz64
 test_compression 8 32 input/8-in-permu dict/8-dict-permu sa/8-dict-permu vbyte rlz/8-in-permu-dict-permu.rlzv
+test_compression 8 32 input/8-in-permu dict/8-dict-permu sa/8-dict-permu delta rlz/8-in-permu-dict-permu.rlzd
 
+
+# Params: input, dictionary, SA, format, expected output.
+# --verify must neither fail on a good parse nor change the output.
+test_verify () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m--verify \033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-verify-$(date +%M%S)
+	if ../build/rlzparse -q --verify -i $1 -d $2 -s $3 -f $4 -o $tmpf \
+			&& cmp -s $tmpf $5; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf
+}
+
+test_verify input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2 rlz/8-in-abacab-dict-ababab.rlz32
+test_verify input/8-in-aaaab dict/8-dict-aaaa sa/8-dict-aaaa vbyte rlz/8-in-aaaab-dict-aaaa.rlzv
+test_verify input/8-in-noise input/8-in-noise sa/8-in-noise 64x2 rlz/8-in-noise-dict-self.rlz64
+
+# Params: dictionary, SA, expected result (ok/bad).
+# --verify-sa should accept the real suffix array and refuse a wrong one.
+test_verify_sa () {
+	echo -ne "Testing rlzparse \033[1;33m--verify-sa\033[0m"\
+		"\033[34m$2\033[0m \033[36m$1\033[0m ($3): ";
+	../build/rlzparse -q --verify-sa -i input/8-in-ababab -d $1 -s $2 \
+		-o /dev/null 2> /dev/null
+	status=$?
+	if [ \( $3 = ok -a $status -eq 0 \) -o \( $3 = bad -a $status -ne 0 \) ]; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+}
+
+test_verify_sa dict/8-dict-ababab sa/8-dict-ababab ok
+test_verify_sa dict/8-dict-permu sa/8-dict-permu ok
+test_verify_sa dict/8-dict-ababab sa/8-dict-aaaa bad
+test_verify_sa dict/8-dict-permu sa/8-dict-ababab bad
+
+# Params: input, dictionary, SA, format, expected output.
+# --sa-on-disk searches differently, but must find the same tokens.
+test_sa_on_disk () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m--sa-on-disk \033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-sa-on-disk-$(date +%M%S)
+	if ../build/rlzparse -q --sa-on-disk -i $1 -d $2 -s $3 -f $4 -o $tmpf \
+			&& cmp -s $tmpf $5; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf
+}
+
+test_sa_on_disk input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2 rlz/8-in-abacab-dict-ababab.rlz32
+test_sa_on_disk input/8-in-permu dict/8-dict-permu sa/8-dict-permu delta rlz/8-in-permu-dict-permu.rlzd
+test_sa_on_disk input/8-in-noise input/8-in-noise sa/8-in-noise vbyte rlz/8-in-noise-dict-self.rlzv
+
+# Params: input, dictionary, format, K.
+# A parse with --sparse-sa K against the sparse suffix array from
+# rlztools.sparsesa should unparse back to the input.
+test_sparse_sa () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m--sparse-sa $4 \033[35m$3\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-sparse-sa-$(date +%M%S)
+	if ../build/rlztools.sparsesa -k $4 $2 $tmpf.sa 2> /dev/null \
+			&& ../build/rlzparse -q --verify --sparse-sa $4 -i $1 -d $2 -s $tmpf.sa -f $3 -o $tmpf.rlz \
+			&& ../build/rlzunparse -q -i $tmpf.rlz -d $2 -f $3 -o $tmpf \
+			&& cmp -s $tmpf $1; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.sa $tmpf.rlz
+}
+
+test_sparse_sa input/8-in-abacab dict/8-dict-ababab 32x2 4
+test_sparse_sa input/8-in-permu dict/8-dict-permu delta 2
+test_sparse_sa input/8-in-noise input/8-in-noise vbyte 8
+
+# Params: input, dictionary, SA, format.
+# Parsing against an .rlzdict bundle of the dictionary and SA should give
+# the same output as parsing against them, and unparse with the bundle.
+test_bundle () {
+	local tmpf
+	echo -ne "Testing \033[1;33m.rlzdict bundle \033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-bundle-$(date +%M%S)
+	if ../build/rlztools.bundle $2 $3 $tmpf.rlzdict 2> /dev/null \
+			&& ../build/rlzparse -q -i $1 -d $2 -s $3 -f $4 -o $tmpf.expected \
+			&& ../build/rlzparse -q -i $1 -d $tmpf.rlzdict -f $4 -o $tmpf.rlz \
+			&& cmp -s $tmpf.rlz $tmpf.expected \
+			&& ../build/rlzunparse -q -i $tmpf.rlz -d $tmpf.rlzdict -f $4 -o $tmpf \
+			&& cmp -s $tmpf $1; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.rlzdict $tmpf.rlz $tmpf.expected
+}
+
+test_bundle input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2
+test_bundle input/8-in-permu dict/8-dict-permu sa/8-dict-permu delta
+test_bundle input/8-in-noise input/8-in-noise sa/8-in-noise vbyte
+
+# Params: input, dictionary, SA, format.
+# A suffix array packed by rlztools.packsa should give the same output as
+# the plain one, and unpack back to it.
+test_packed_sa () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33mpacked SA \033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-packed-sa-$(date +%M%S)
+	if ../build/rlztools.packsa $3 $tmpf.psa 2> /dev/null \
+			&& ../build/rlzparse -q -i $1 -d $2 -s $3 -f $4 -o $tmpf.expected \
+			&& ../build/rlzparse -q -i $1 -d $2 -s $tmpf.psa -f $4 -o $tmpf.rlz \
+			&& cmp -s $tmpf.rlz $tmpf.expected \
+			&& ../build/rlztools.packsa --unpack $tmpf.psa $tmpf.sa 2> /dev/null \
+			&& cmp -s $tmpf.sa $3; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf.psa $tmpf.sa $tmpf.rlz $tmpf.expected
+}
+
+test_packed_sa input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2
+test_packed_sa input/8-in-permu dict/8-dict-permu sa/8-dict-permu delta
+test_packed_sa input/8-in-noise input/8-in-noise sa/8-in-noise vbyte
+
+# Params: input, dictionary, width, format, extra options.
+# The files are read as symbols of the given width. A parse against the
+# dictionary's ranks with --alphabet should match the plain parse, and
+# unparse back to the input. With --verify among the extra options, both
+# parses should print the same checksum, the FNV-1a of the input file.
+test_alphabet () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m--alphabet ${5:+$5 }\033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-alphabet-$(date +%M%S)
+	if ../build/rlztools.alphabet -w $3 $2 $tmpf.alpha $tmpf.ranks 2> /dev/null \
+			&& ../build/rlztools.sparsesa -w $3 -k 1 $2 $tmpf.sa 2> /dev/null \
+			&& ../build/rlzparse -w $3 $5 -i $1 -d $2 -s $tmpf.sa -f $4 \
+				-o $tmpf.expected 2> $tmpf.log.expected \
+			&& ../build/rlzparse -w $3 $5 --alphabet $tmpf.alpha -i $1 -d $tmpf.ranks \
+				-s $tmpf.sa -f $4 -o $tmpf.rlz 2> $tmpf.log \
+			&& cmp -s $tmpf.rlz $tmpf.expected \
+			&& [ "$(grep checksum $tmpf.log)" = "$(grep checksum $tmpf.log.expected)" ] \
+			&& ../build/rlzunparse -q -w $3 --alphabet $tmpf.alpha -i $tmpf.rlz \
+				-d $tmpf.ranks -f $4 -o $tmpf \
+			&& cmp -s $tmpf $1; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.alpha $tmpf.ranks $tmpf.sa $tmpf.rlz $tmpf.expected \
+		$tmpf.log $tmpf.log.expected
+}
+
+test_alphabet input/8-in-abacab dict/8-dict-ababab 16 32x2
+test_alphabet input/8-in-permu dict/8-dict-permu 16 vbyte
+test_alphabet input/8-in-ababab input/8-in-noise 32 delta
+test_alphabet input/8-in-noise input/8-in-noise 64 vbyte --verify
+test_alphabet input/8-in-abacab dict/8-dict-ababab 16 32x2 --verify
+
+# Params: input, dictionary, width, format, extra options.
+# The first 4980 bytes of the files (a multiple of 3, 5 and 6) are read as
+# packed symbols of the given width; the parse should unparse back to them.
+test_packed_width () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m-w $3 ${5:+$5 }\033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-packed-width-$(date +%M%S)
+	head -c 4980 $1 > $tmpf.in
+	head -c 4980 $2 > $tmpf.dict
+	if ../build/rlztools.sparsesa -w $3 -k 1 $tmpf.dict $tmpf.sa 2> /dev/null \
+			&& ../build/rlztools.checksa -q -w $3 $tmpf.dict $tmpf.sa \
+			&& ../build/rlzparse -q --verify $5 -w $3 -i $tmpf.in -d $tmpf.dict \
+				-s $tmpf.sa -f $4 -o $tmpf.rlz \
+			&& ../build/rlzunparse -q $5 -w $3 -i $tmpf.rlz -d $tmpf.dict -f $4 -o $tmpf \
+			&& cmp -s $tmpf $tmpf.in; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.in $tmpf.dict $tmpf.sa $tmpf.rlz
+}
+
+test_packed_width input/8-in-abacab input/8-in-ababab 24 32x2
+test_packed_width input/8-in-permu input/8-in-permu 40 delta
+test_packed_width input/8-in-noise input/8-in-abacab 48 64x2
+test_packed_width input/8-in-noise input/8-in-ababab 24 ascii --literal-runs
+
+# Params: input, dictionary, SA, format.
+# A --literal-runs parse should unparse back to the input with
+# rlzunparse --literal-runs.
+test_literal_runs () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m--literal-runs \033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-literal-runs-$(date +%M%S)
+	if ../build/rlzparse -q --verify --literal-runs -i $1 -d $2 -s $3 -f $4 -o $tmpf.rlz \
+			&& ../build/rlzunparse -q --literal-runs -i $tmpf.rlz -d $2 -f $4 -o $tmpf \
+			&& cmp -s $tmpf $1; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.rlz
+}
+
+test_literal_runs input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2
+test_literal_runs input/8-in-permu dict/8-dict-ababab sa/8-dict-ababab vbyte
+test_literal_runs input/8-in-noise dict/8-dict-aaaa sa/8-dict-aaaa ascii
+
+# Params: input, dictionary, SA, format.
+# rlzexplain --analyze should count the literals of a run one by one, so
+# only the token and byte counts may differ from a parse without runs, and
+# its token count should be the one rlzparse --stats-json gives.
+test_analyze_literal_runs () {
+	local tmpf strip
+	echo -ne "Testing rlzexplain \033[1;33m--analyze --literal-runs \033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzexplain-analyze-runs-$(date +%M%S)
+	strip='s/"(tokens|literal_runs|rlz_bytes|ratio)": [0-9.]+(, )?//g'
+	if ../build/rlzparse -q --stats-json --literal-runs -i $1 -d $2 -s $3 -f $4 -o $tmpf.rlz \
+				| grep -o '"tokens": [0-9]*' > $tmpf.tokens \
+			&& ../build/rlzparse -q -i $1 -d $2 -s $3 -f $4 -o $tmpf.plain.rlz \
+			&& ../build/rlztools.rlzexplain --analyze --json --literal-runs \
+				-i $tmpf.rlz -d $2 -f $4 > $tmpf.json \
+			&& grep -o '"tokens": [0-9]*' $tmpf.json | head -n 1 | cmp -s - $tmpf.tokens \
+			&& sed -E -i "$strip" $tmpf.json \
+			&& ../build/rlztools.rlzexplain --analyze --json \
+				-i $tmpf.plain.rlz -d $2 -f $4 | sed -E "$strip" > $tmpf.json.expected \
+			&& cmp -s $tmpf.json $tmpf.json.expected; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf.rlz $tmpf.plain.rlz $tmpf.tokens $tmpf.json $tmpf.json.expected
+}
+
+test_analyze_literal_runs input/8-in-noise dict/8-dict-aaaa sa/8-dict-aaaa vbyte
+test_analyze_literal_runs input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2
+
+# Params: input, dictionary, SA, format.
+# Whichever equally long match --locality picks, the output must unparse
+# back to the input.
+test_locality () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m--locality \033[35m$4\033[0m"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-locality-$(date +%M%S)
+	if ../build/rlzparse -q --verify --locality 64 -i $1 -d $2 -s $3 -f $4 -o $tmpf.rlz \
+			&& ../build/rlzunparse -q -i $tmpf.rlz -d $2 -f $4 -o $tmpf \
+			&& cmp -s $tmpf $1; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.rlz
+}
+
+test_locality input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab delta
+test_locality input/8-in-permu dict/8-dict-permu sa/8-dict-permu 32x2
+
+# Params: input, dictionary, SA, format, from, to, extra options.
+# rlzunparse --index with the index from rlzparse --index should output
+# symbols from..to of the input, the same as the input itself has.
+test_index () {
+	local tmpf
+	echo -ne "Testing rlzparse \033[1;33m--index \033[35m$4\033[0m $7"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m $5-$6: ";
+	tmpf=testfile-rlzparse-index-$(date +%M%S)
+	tail -c +$5 $1 | head -c $(($6 - $5 + 1)) > $tmpf.expected
+	if ../build/rlzparse -q $7 --index $tmpf.idx -i $1 -d $2 -s $3 -f $4 -o $tmpf.rlz \
+			&& ../build/rlzunparse -q $7 --index $tmpf.idx -a $5 -b $6 -i $tmpf.rlz -d $2 -f $4 -o $tmpf \
+			&& cmp -s $tmpf $tmpf.expected; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.rlz $tmpf.idx $tmpf.expected
+}
+
+test_index input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2 1777 2345
+test_index input/8-in-permu dict/8-dict-permu sa/8-dict-permu vbyte 100 101
+test_index input/8-in-noise dict/8-dict-aaaa sa/8-dict-aaaa delta 4000 4999
+test_index input/8-in-noise dict/8-dict-aaaa sa/8-dict-aaaa 32x2 4000 4999 --literal-runs
+test_index input/8-in-noise dict/8-dict-aaaa sa/8-dict-aaaa 64x2 1234 4321 --literal-runs
+
+# rlzunparse --sparse, which reads only the parts of the dictionary that
+# symbols from..to need, should output the same as the input has. $7 are
+# more options for both, like --literal-runs.
+test_sparse () {
+	local tmpf
+	echo -ne "Testing rlzunparse \033[1;33m--sparse \033[35m$4\033[0m $7"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m $5-$6: ";
+	tmpf=testfile-rlzparse-sparse-$(date +%M%S)
+	tail -c +$5 $1 | head -c $(($6 - $5 + 1)) > $tmpf.expected
+	if ../build/rlzparse -q $7 -i $1 -d $2 -s $3 -f $4 -o $tmpf.rlz \
+			&& ../build/rlzunparse -q --sparse $7 -a $5 -b $6 -i $tmpf.rlz -d $2 -f $4 -o $tmpf \
+			&& cmp -s $tmpf $tmpf.expected; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.rlz $tmpf.expected
+}
+
+test_sparse input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2 1777 2345
+test_sparse input/8-in-permu dict/8-dict-permu sa/8-dict-permu delta 1 101
+test_sparse input/8-in-noise dict/8-dict-aaaa sa/8-dict-aaaa vbyte 4000 4999 --literal-runs
+
+# rlzunparse --external-memory, which copies phrases in dictionary order,
+# should give back the input. $5 are more options for both.
+test_external () {
+	local tmpf
+	echo -ne "Testing rlzunparse \033[1;33m--external-memory \033[35m$4\033[0m $5"\
+		"\033[34m$1\033[0m \033[36m$2\033[0m: ";
+	tmpf=testfile-rlzparse-external-$(date +%M%S)
+	if ../build/rlzparse -q $5 -i $1 -d $2 -s $3 -f $4 -o $tmpf.rlz \
+			&& ../build/rlzunparse -q --external-memory 1 $5 -i $tmpf.rlz -d $2 -f $4 -o $tmpf \
+			&& cmp -s $tmpf $1; then
+		echo -e "\033[1;32mPASS\033[0m"
+	else
+		echo -e "\033[1;31mFAIL\033[0m"
+	fi
+	rm -f $tmpf $tmpf.rlz
+}
+
+test_external input/8-in-abacab dict/8-dict-ababab sa/8-dict-ababab 32x2
+test_external input/8-in-noise dict/8-dict-aaaa sa/8-dict-aaaa delta --literal-runs
@@ -32,6 +32,7 @@ decompress_compare () {
 test_decompression 8 32x2 rlz/8-in-aaaab-dict-aaaa.rlz32 dict/8-dict-aaaa input/8-in-aaaab
 test_decompression 8 64x2 rlz/8-in-aaaab-dict-aaaa.rlz64 dict/8-dict-aaaa input/8-in-aaaab
 test_decompression 8 vbyte rlz/8-in-aaaab-dict-aaaa.rlzv dict/8-dict-aaaa input/8-in-aaaab
+test_decompression 8 delta rlz/8-in-aaaab-dict-aaaa.rlzd dict/8-dict-aaaa input/8-in-aaaab
 test_decompression 8 vbyte rlz/8-in-aaaab-dict-ababab.rlzv dict/8-dict-ababab input/8-in-aaaab
 
 test_decompression 8 32x2 rlz/8-in-ababab-dict-ababab.rlz32 dict/8-dict-ababab input/8-in-ababab
@@ -40,6 +41,7 @@ test_decompression 8 64x2 rlz/8-in-ababab-dict-ababab.rlz64 dict/8-dict-ababab i
 test_decompression 8 64x2 rlz/8-in-ababab-dict-ababab.rlz64 dict/8-dict-ababab input/8-in-ababab
 test_decompression 8 vbyte rlz/8-in-abacab-dict-ababab.rlzv dict/8-dict-ababab input/8-in-abacab
 test_decompression 8 vbyte rlz/8-in-abacab-dict-ababab.rlzv dict/8-dict-ababab input/8-in-abacab
+test_decompression 8 delta rlz/8-in-abacab-dict-ababab.rlzd dict/8-dict-ababab input/8-in-abacab
 
 test_decompression 8 32x2 rlz/8-in-noise-dict-self.rlz32 input/8-in-noise input/8-in-noise
 test_decompression 8 64x2 rlz/8-in-noise-dict-self.rlz64 input/8-in-noise input/8-in-noise
@@ -48,4 +50,5 @@ test_decompression 8 vbyte rlz/8-in-noise-dict-self.rlzv input/8-in-noise input/
 test_decompression 8 32x2 rlz/8-in-permu-dict-permu.rlz32 dict/8-dict-permu input/8-in-permu
 test_decompression 8 64x2 rlz/8-in-permu-dict-permu.rlz64 dict/8-dict-permu input/8-in-permu
 test_decompression 8 vbyte rlz/8-in-permu-dict-permu.rlzv dict/8-dict-permu input/8-in-permu
+test_decompression 8 delta rlz/8-in-permu-dict-permu.rlzd dict/8-dict-permu input/8-in-permu
 